@@ -0,0 +1,422 @@
+// Microbenchmarks of the wave code, built without GLFW or a window
+// Usage: OceanSimBench [results.json]
+// Prints a table, and writes the results as JSON to the given file or to
+// stdout, so runs can be compared across commits
+// Fails when the batched displacements drift from the scalar reference
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include "Water.h"
+#include "Buoyancy.h"
+#include "ThreadPool.h"
+
+// Each measurement repeats its run until it has taken this many seconds,
+// and keeps the fastest of several such batches
+#define BENCH_MIN_TIME 0.1
+#define BENCH_BATCHES 5
+
+// Largest difference allowed between the batched kernels and the scalar
+// reference, in meters
+// The run fails when any batch is further off
+#define BENCH_MAX_ERROR 1e-3
+
+// Ocean the queries are spread across, matching the scene
+#define BENCH_PLANE_RES 1000
+#define BENCH_PLANE_LEN 100
+#define BENCH_SPECTRUM_RES 256
+
+// Hull points of each floating body, matching the surfboards
+#define BENCH_BODY_POINTS_X 2
+#define BENCH_BODY_POINTS_Z 4
+#define BENCH_STEP (1.0f / 60.0f)
+
+// The surface update is swept over powers of two threads up to the cores,
+// and up to at least this many
+#define BENCH_SWEEP_THREADS 4
+
+
+struct BenchResult
+{
+	std::string benchmark;
+	std::string waveFunction;
+	int waveCount;
+	size_t pointCount;
+	double nsPerPoint;
+	double pointsPerSecond;
+	int threads;
+	double speedup;		// Against the scalar reference or one thread, or zero
+	double maxError;	// Against the scalar reference, or zero
+};
+
+const char* waveFunctionName(WaveFunction waveFunction)
+{
+	switch (waveFunction)
+	{
+	case SINE:
+		return "sine";
+	case STEEP_SINE:
+		return "steep_sine";
+	case GERSTNER:
+		return "gerstner";
+	case SPECTRAL:
+		return "spectral";
+	}
+	return "unknown";
+}
+
+// Returns the fastest time of one run, in seconds
+double timeRun(const std::function<void()>& run)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Warm up the caches and the thread pool
+	run();
+
+	double best = 1e30;
+	for (int batch = 0; batch < BENCH_BATCHES; batch++)
+	{
+		int runs = 0;
+		Clock::time_point start = Clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			run();
+			runs++;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (elapsed < BENCH_MIN_TIME);
+
+		best = std::min(best, elapsed / runs);
+	}
+	return best;
+}
+
+class Bench
+{
+public:
+	Bench() : water(BENCH_PLANE_RES, BENCH_PLANE_LEN, SINE) {}
+
+	void run()
+	{
+		const WaveFunction waveFunctions[] = { SINE, STEEP_SINE, GERSTNER, SPECTRAL };
+		const int waveCounts[] = { 4, 16, 64 };
+		const size_t queryCounts[] = { 64, 1024, 16384, 262144 };
+
+		water.generateSpectrum(1, BENCH_SPECTRUM_RES, 6.0f, glm::vec2(0.0f, -1.0f), SpectrumType::JONSWAP);
+
+		for (WaveFunction waveFunction : waveFunctions)
+		{
+			// The spectral ocean is sampled from its maps, whatever the wave count
+			bool spectral = waveFunction == SPECTRAL;
+			for (int waveCount : waveCounts)
+			{
+				if (spectral && waveCount != waveCounts[0])
+					continue;
+
+				setupWaves(waveFunction, waveCount);
+				int reportedCount = spectral ? 0 : waveCount;
+
+				benchGenerateWaves(waveFunction, reportedCount);
+				benchPointQueries(waveFunction, reportedCount, queryCounts[1]);
+				for (size_t queryCount : queryCounts)
+				{
+					benchBatchedQueries(waveFunction, reportedCount, queryCount);
+				}
+			}
+		}
+
+		const int planeResolutions[] = { 100, 250, 1000 };
+		for (int planeRes : planeResolutions)
+		{
+			benchGeneratePlane(planeRes);
+		}
+
+		benchDisplaceSurface(BENCH_PLANE_RES);
+
+		const size_t bodyCounts[] = { 16, 1024, 4096 };
+		setupWaves(GERSTNER, 16);
+		for (size_t bodyCount : bodyCounts)
+		{
+			benchBuoyancyStep(bodyCount);
+		}
+	}
+
+	void printTable(std::ostream& out) const
+	{
+		out << std::left << std::setw(24) << "benchmark" << std::setw(12) << "function"
+			<< std::right << std::setw(7) << "waves" << std::setw(10) << "points"
+			<< std::setw(12) << "ns/point" << std::setw(16) << "points/s"
+			<< std::setw(9) << "threads" << std::setw(10) << "speedup" << std::setw(12) << "max error" << "\n";
+		for (const BenchResult& r : results)
+		{
+			out << std::left << std::setw(24) << r.benchmark << std::setw(12) << r.waveFunction
+				<< std::right << std::setw(7) << r.waveCount << std::setw(10) << r.pointCount
+				<< std::fixed << std::setprecision(2) << std::setw(12) << r.nsPerPoint
+				<< std::setprecision(0) << std::setw(16) << r.pointsPerSecond
+				<< std::setw(9) << r.threads << std::setprecision(2) << std::setw(10) << r.speedup
+				<< std::scientific << std::setw(12) << r.maxError << std::fixed << "\n";
+		}
+		out << std::defaultfloat << std::setprecision(6);
+	}
+
+	void writeJson(std::ostream& out) const
+	{
+		out << "{\n  \"threads\": " << ThreadPool::getInstance()->getThreadCount()
+			<< ",\n  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const BenchResult& r = results[i];
+			out << "    {\"benchmark\": \"" << r.benchmark << "\", \"waveFunction\": \"" << r.waveFunction
+				<< "\", \"waveCount\": " << r.waveCount << ", \"pointCount\": " << r.pointCount
+				<< ", \"nsPerPoint\": " << std::setprecision(6) << r.nsPerPoint
+				<< ", \"pointsPerSecond\": " << std::setprecision(10) << r.pointsPerSecond
+				<< ", \"threads\": " << r.threads
+				<< ", \"speedup\": " << std::setprecision(6) << r.speedup
+				<< ", \"maxError\": " << r.maxError << "}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n" << std::setprecision(6);
+	}
+
+	// Whether every batch stayed within BENCH_MAX_ERROR of the scalar reference
+	bool isAccurate() const
+	{
+		for (const BenchResult& r : results)
+		{
+			if (r.maxError > BENCH_MAX_ERROR)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	void setupWaves(WaveFunction waveFunction, int waveCount)
+	{
+		water.setWaveFunction(waveFunction);
+		water.generateWaves(2, 8.0f, 0.05f, 35.0f, waveCount);
+		water.advanceWaves(0.0);
+	}
+
+	void addResult(const std::string& benchmark, const std::string& waveFunction,
+		int waveCount, size_t pointCount, double seconds,
+		double speedup = 0.0, double maxError = 0.0)
+	{
+		BenchResult r;
+		r.benchmark = benchmark;
+		r.waveFunction = waveFunction;
+		r.waveCount = waveCount;
+		r.pointCount = pointCount;
+		r.nsPerPoint = seconds * 1e9 / pointCount;
+		r.pointsPerSecond = pointCount / seconds;
+		r.threads = ThreadPool::getInstance()->getThreadCount();
+		r.speedup = speedup;
+		r.maxError = maxError;
+		results.push_back(r);
+	}
+
+	// Random points over the plane, the same for every run
+	void makePoints(size_t count)
+	{
+		std::mt19937 generator(7);
+		std::uniform_real_distribution<float> dist(-0.5f * BENCH_PLANE_LEN, 0.5f * BENCH_PLANE_LEN);
+
+		xs.resize(count);
+		zs.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			xs[i] = dist(generator);
+			zs[i] = dist(generator);
+		}
+		heights.assign(count, 0.0f);
+		dxs.assign(count, 0.0f);
+		dzs.assign(count, 0.0f);
+	}
+
+	// One point per call, as gameplay code would ask
+	void benchPointQueries(WaveFunction waveFunction, int waveCount, size_t count)
+	{
+		makePoints(count);
+		float time = (float)water.getWaveTime();
+		double seconds = timeRun([&]() {
+			for (size_t i = 0; i < count; i++)
+			{
+				heights[i] = water.getDisplacement(glm::vec3(xs[i], 0.0f, zs[i]), time).y;
+			}
+		});
+		addResult("getDisplacement", waveFunctionName(waveFunction), waveCount, count, seconds);
+	}
+
+	// The scalar reference, then the batched kernels against it, then the
+	// inverted surface heights, all in one batch on this thread
+	void benchBatchedQueries(WaveFunction waveFunction, int waveCount, size_t count)
+	{
+		makePoints(count);
+		float time = (float)water.getWaveTime();
+		double scalarSeconds = timeRun([&]() {
+			water.getDisplacementsScalar(xs.data(), zs.data(), count, time,
+				heights.data(), dxs.data(), dzs.data());
+		});
+		addResult("getDisplacementsScalar", waveFunctionName(waveFunction), waveCount, count, scalarSeconds);
+
+		std::vector<float> scalarHeights = heights, scalarDxs = dxs, scalarDzs = dzs;
+		double seconds = timeRun([&]() {
+			water.getDisplacements(xs.data(), zs.data(), count, heights.data(), dxs.data(), dzs.data());
+		});
+
+		double maxError = 0.0;
+		for (size_t i = 0; i < count; i++)
+		{
+			maxError = std::max(maxError, (double)std::abs(heights[i] - scalarHeights[i]));
+			maxError = std::max(maxError, (double)std::abs(dxs[i] - scalarDxs[i]));
+			maxError = std::max(maxError, (double)std::abs(dzs[i] - scalarDzs[i]));
+		}
+		addResult("getDisplacements", waveFunctionName(waveFunction), waveCount, count, seconds,
+			scalarSeconds / seconds, maxError);
+
+		// Cold guesses each run, as for probes that moved far since the last frame
+		std::vector<float> guessXs(count), guessZs(count);
+		seconds = timeRun([&]() {
+			guessXs = xs;
+			guessZs = zs;
+			water.getSurfaceHeights(xs.data(), zs.data(), count, heights.data(),
+				guessXs.data(), guessZs.data());
+		});
+		addResult("getSurfaceHeights", waveFunctionName(waveFunction), waveCount, count, seconds);
+	}
+
+	// Wave generation, per wave
+	void benchGenerateWaves(WaveFunction waveFunction, int waveCount)
+	{
+		if (waveCount == 0)
+			return;
+
+		double seconds = timeRun([&]() {
+			water.generateWaves(2, 8.0f, 0.05f, 35.0f, waveCount);
+		});
+		addResult("generateWaves", waveFunctionName(waveFunction), waveCount, waveCount, seconds);
+	}
+
+	// Vertices and indices of the plane mesh, per vertex
+	void benchGeneratePlane(int planeRes)
+	{
+		Water plane(planeRes, BENCH_PLANE_LEN, SINE);
+		std::vector<unsigned short> indices;
+		std::vector<IndexTile> tiles;
+		std::vector<unsigned int> listIndices;
+
+		double seconds = timeRun([&]() {
+			plane.generatePlane(indices, tiles, listIndices);
+		});
+		size_t vertices = (size_t)(planeRes + 1) * (planeRes + 1);
+		addResult("generatePlane", "none", 0, vertices, seconds);
+	}
+
+	// The CPU displaced plane with its normals, per vertex, across thread
+	// counts, against one thread
+	void benchDisplaceSurface(int planeRes)
+	{
+		Water plane(planeRes, BENCH_PLANE_LEN, GERSTNER);
+		std::vector<unsigned short> indices;
+		std::vector<IndexTile> tiles;
+		std::vector<unsigned int> listIndices;
+		plane.generatePlane(indices, tiles, listIndices);
+		plane.generateWaves(2, 8.0f, 0.05f, 35.0f, 16);
+		plane.advanceWaves(0.0);
+
+		size_t vertices = (size_t)(planeRes + 1) * (planeRes + 1);
+		std::vector<float> vertexData(STREAM_ATTRIBUTES * vertices);
+
+		ThreadPool* pool = ThreadPool::getInstance();
+		int cores = pool->getThreadCount();
+		int maxThreads = std::max(cores, BENCH_SWEEP_THREADS);
+		std::vector<int> threadCounts;
+		for (int threads = 1; threads < maxThreads; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(maxThreads);
+
+		double oneThread = 0.0;
+		for (int threads : threadCounts)
+		{
+			pool->setThreadCount(threads);
+			double seconds = timeRun([&]() {
+				plane.displaceSurface(vertexData.data());
+			});
+			if (threads == 1)
+				oneThread = seconds;
+			addResult("displaceSurface", waveFunctionName(GERSTNER), 16, vertices, seconds,
+				oneThread / seconds);
+		}
+		pool->setThreadCount(cores);
+	}
+
+	// One buoyancy step of many bodies spread over the plane, per hull point
+	void benchBuoyancyStep(size_t bodyCount)
+	{
+		std::mt19937 generator(11);
+		std::uniform_real_distribution<float> dist(-0.5f * BENCH_PLANE_LEN, 0.5f * BENCH_PLANE_LEN);
+
+		Buoyancy buoyancy;
+		glm::vec3 size(1.0f, 0.3f, 4.6f);
+		float mass = 0.5f * WATER_DENSITY * size.x * size.y * size.z;
+		for (size_t i = 0; i < bodyCount; i++)
+		{
+			buoyancy.addBody(glm::vec3(dist(generator), 0.0f, dist(generator)), size, mass,
+				BENCH_BODY_POINTS_X, BENCH_BODY_POINTS_Z);
+		}
+
+		double seconds = timeRun([&]() {
+			buoyancy.step(water, BENCH_STEP);
+		});
+		addResult("Buoyancy::step", waveFunctionName(GERSTNER), 16,
+			buoyancy.getProbes().size(), seconds);
+	}
+
+	Water water;
+	std::vector<float> xs, zs, heights, dxs, dzs;
+	std::vector<BenchResult> results;
+};
+
+
+int main(int argc, char** argv)
+{
+	Bench bench;
+	bench.run();
+
+	if (argc > 1)
+	{
+		bench.printTable(std::cout);
+
+		std::ofstream file(argv[1]);
+		if (!file.is_open())
+		{
+			std::cerr << "Could not open file: '" << argv[1] << "'" << std::endl;
+			return 1;
+		}
+		bench.writeJson(file);
+	}
+	else
+	{
+		// Keep stdout valid JSON
+		bench.printTable(std::cerr);
+		bench.writeJson(std::cout);
+	}
+
+	if (!bench.isAccurate())
+	{
+		std::cerr << "Batched displacements are more than " << BENCH_MAX_ERROR
+			<< " off the scalar reference" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#version 420 core // For sampler binding support
+
+layout (location = 0) out float height;
+
+flat in vec2 probe;
+
+#include "waves.glsl"
+
+uniform int waveFunction;
+uniform int iterations;
+
+// Displacement map of the spectral ocean, which tiles every mapLength meters
+uniform sampler2D displacementMap;
+uniform float mapLength;
+
+
+vec3 displace(vec2 xz)
+{
+	if (waveFunction == SPECTRAL)
+	{
+		vec2 uv = xz / mapLength + 0.5 / vec2(textureSize(displacementMap, 0));
+		return texture(displacementMap, uv).xyz;
+	}
+
+	vec3 v = vec3(xz.x, 0.0, xz.y);
+	vec3 p, n;
+	sumWaves(waveFunction, v, p, n);
+	return p - v;
+}
+
+void main()
+{
+	// Find the undisplaced point that lands on the probe, like
+	// Water::getSurfaceHeights, then take its height
+	vec2 guess = probe;
+	for (int i = 0; i < iterations; i++)
+	{
+		guess = probe - displace(guess).xz;
+	}
+
+	height = displace(guess).y;
+}
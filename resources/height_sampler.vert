@@ -0,0 +1,18 @@
+#version 420 core
+
+layout (location = 0) in vec2 aProbe;
+
+flat out vec2 probe;
+
+// Size of the height target in pixels
+uniform vec2 targetSize;
+
+void main()
+{
+	// Each point lands on the pixel of its index, in rows of the target
+	int width = int(targetSize.x);
+	vec2 pixel = vec2(gl_VertexID % width, gl_VertexID / width) + 0.5;
+	gl_Position = vec4(pixel / targetSize * 2.0 - 1.0, 0.0, 1.0);
+
+	probe = aProbe;
+}
@@ -3,6 +3,7 @@
 in vec3 fragPos;
 in vec3 fragNor;
 in vec2 texCoord;
+in vec3 surfacePos;
 
 out vec4 fragColor;
 
@@ -17,18 +18,47 @@ uniform vec3 cameraPos;
 
 uniform samplerCube cubemap;
 
+uniform mat4 model;
+
+#include "waves.glsl"
+
+uniform int waveFunction;
+
+#include "water_maps.glsl"
+
+// Evaluate the normal for each pixel instead of interpolating the vertex
+// normals, so a coarse mesh keeps the detail of the short waves
+uniform bool pixelNormals;
+
 // Debug flags
 uniform bool debugNormals;
 
 
+vec3 pixelNormal()
+{
+	// Same surface the vertices were displaced onto, at this pixel's
+	// undisplaced position
+	vec3 p, n;
+	if (useWaveMap || waveFunction == SPECTRAL)
+	{
+		sampleMaps(surfacePos, p, n);
+	}
+	else
+	{
+		sumWaves(waveFunction, surfacePos, p, n);
+	}
+	return normalize(mat3(model) * n);
+}
+
 void main()
 {
+	vec3 normal = pixelNormals ? pixelNormal() : normalize(fragNor);
+
 	if (debugNormals) {
-		fragColor = vec4(normalize(fragNor) * 0.5 + 0.5, 1.0);
+		fragColor = vec4(normal * 0.5 + 0.5, 1.0);
 		return;
 	}
 
-	vec3 normal = normalize(fragNor);
 	vec3 light = normalize(-lightDir);
 	vec3 view = normalize(cameraPos - fragPos);
 
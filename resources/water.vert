@@ -2,8 +2,6 @@
 
 #define PI 3.1415926538
 
-#define MAX_WAVES 16
-
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNor;
 layout (location = 2) in vec2 aTexCoord;
@@ -11,6 +9,7 @@ layout (location = 2) in vec2 aTexCoord;
 out vec3 fragPos;
 out vec3 fragNor;
 out vec2 texCoord;
+out vec3 surfacePos;	// Undisplaced, for the per pixel normals
 
 layout (std140, binding = 0) uniform Matrices
 {
@@ -19,194 +18,124 @@ layout (std140, binding = 0) uniform Matrices
 };
 uniform mat4 model;
 
-struct Wave
-{
-	vec4 direction;		// {Dx, Dz, 0, 0}
-	float amplitude;
-	float frequency;
-	float phase;
-	float steepness;
-};
-
-layout(std140, binding = 1) uniform Waves
-{
-	Wave waves[MAX_WAVES];
-};
+#include "waves.glsl"
 
 uniform int waveFunction;
-const int SINE = 0;
-const int STEEP_SINE = 1;
-const int GERSTNER = 2;
-
-uniform float time;
-
-
-float sine(vec3 v, Wave w)
-{
-	float xz = dot(v.xz, w.direction.xy);
-	return w.amplitude * sin(xz * w.frequency + time * w.phase);
-}
 
-vec3 sinePartials(vec3 v, Wave w)
+// Matches WaterGeometry
+const int MESH = 0;
+const int GRID = 1;
+const int CLIPMAP = 2;
+const int QUADTREE = 3;
+const int PROJECTED = 4;
+uniform int waterGeometry;
+
+// Plane generated from the vertex and instance IDs instead of vertex data
+uniform int planeRes;
+uniform float planeLen;
+
+// Clipmap blocks and quadtree patches generated the same way
+uniform vec2 levelOrigin;		// First vertex in whole cells from the world origin
+uniform float levelSpacing;
+uniform vec2 blockStart;		// First cell of the block within the level
+uniform vec2 morphRange;		// Distances where odd vertices start and finish morphing
+uniform vec3 morphViewer;
+
+// Screen-space grid projected onto the water plane
+uniform mat4 invViewProjection;
+uniform vec2 projectedRes;		// Quads across and down the screen
+uniform float projectedMargin;	// Fraction of the screen the grid extends past each edge
+
+#include "water_maps.glsl"
+
+
+// Each instance is a row of quads between z and z + 1, drawn as a
+// triangle strip that alternates between the two edges of the row
+// Matches the triangulation of Water::generateMesh
+vec3 gridPosition()
 {
-	vec2 wDir = w.direction.xy;	// {Dx, Dz}
-	float xz = dot(v.xz, wDir);
+	float stepLen = planeLen / float(planeRes);
+	int x = gl_VertexID >> 1;
+	int z = gl_InstanceID + (gl_VertexID & 1);
 
-	// Calculate partial derivatives of the sine function
-	vec2 partials = w.frequency * w.amplitude * wDir * cos(xz * w.frequency + time * w.phase);
-	return vec3(partials.x, 1.0, partials.y);
-}
-
-void sumSines(in vec3 v, out vec3 p, out vec3 n)
-{
-	// H(x, z, t) = sum of sines
-	// P(x, z, t) = [x, H(x, z, t), z]
-	p = v;
-	vec3 partials = vec3(0.0);
-
-	// Sum displacement and partial derivatives of all waves
-	for (int i = 0; i < MAX_WAVES; i++)
-	{
-		p.y += sine(v, waves[i]);
-		partials += sinePartials(v, waves[i]);
-	}
-
-	// Calculate the normal by crossing the summed binormal and tangent vectors
-	// B = [0, pd/pdz{P}, 1]
-	// T = [1, pd/pdx{P}, 0]
-	// N = B x T = [-pd/pdx{P}, 1, -pd/pdz{P}]
-	n = normalize(vec3(-partials.x, 1.0, -partials.z));
-}
-
-float steepSine(vec3 v, Wave w)
-{
-	float xz = dot(v.xz, w.direction.xy);
-	return 2 * w.amplitude * pow((sin(xz * w.frequency + time * w.phase) + 1.0) / 2.0, w.steepness);
+	return vec3(float(x) * stepLen - 0.5 * planeLen, 0.0, float(z) * stepLen - 0.5 * planeLen);
 }
 
-vec3 steepSinePartials(vec3 v, Wave w)
+// Each instance is a row of quads of the block, like the plane grid
+vec3 levelPosition()
 {
-	vec2 wDir = w.direction.xy;	// {Dx, Dz}
-	float xz = dot(v.xz, wDir);
-	float f = xz * w.frequency + time * w.phase;
-
-	// Calculate partial derivatives of the steep sine function
-	float powTerm = pow((sin(f) + 1.0) / 2.0, w.steepness - 1.0);
-	float scaleFactor = w.steepness * w.frequency * w.amplitude * powTerm;
-	
-	vec2 partials = scaleFactor * wDir * cos(f);
-	return vec3(partials.x, 1.0, partials.y);
+	vec2 cell = levelOrigin + blockStart + vec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+	vec2 xz = cell * levelSpacing;
+
+	// Slide odd vertices onto their even neighbors towards the outer edge,
+	// so the edge matches the coarser level's grid
+	// Clipmap rings are squares around the viewer, quadtree ranges are spheres
+	vec3 toViewer = abs(vec3(xz.x, 0.0, xz.y) - morphViewer);
+	float distance = waterGeometry == CLIPMAP ? max(toViewer.x, toViewer.z) : length(toViewer);
+	float morph = clamp((distance - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+	xz = (cell - mod(cell, 2.0) * morph) * levelSpacing;
+
+	return vec3(xz.x, 0.0, xz.y);
 }
 
-void sumSteepSine(in vec3 v, out vec3 p, out vec3 n)
+// Each instance is a row of quads across the screen, cast from the camera
+// onto the y = 0 plane
+vec3 projectedPosition()
 {
-	// H(x, z, t) = sum of sines
-	// P(x, z, t) = [x, H(x, z, t), z]
-	p = v;
-	vec3 partials = vec3(0.0);
-
-	// Sum displacement and partial derivatives of all waves
-	for (int i = 0; i < MAX_WAVES; i++)
-	{
-		p.y += steepSine(v, waves[i]);
-		partials += steepSinePartials(v, waves[i]);
-	}
-
-	// Calculate the normal by crossing the summed binormal and tangent vectors
-	// B = [0, pd/pdz{P}, 1]
-	// T = [1, pd/pdx{P}, 0]
-	// N = B x T = [-pd/pdx{P}, 1, -pd/pdz{P}]
-	n = normalize(vec3(-partials.x, 1.0, -partials.z));
-}
-
-vec3 gerstner(vec3 v, Wave w)
-{
-	float xz = dot(v.xz, w.direction.xy);
-	float f = xz * w.frequency + time * w.phase;
-	
-	float s = sin(f);
-	float c = cos(f);
-	
-	vec3 g = vec3(0.0);
-	g.x = w.steepness * w.amplitude * w.direction.x * c;
-	g.y = w.amplitude * s;
-	g.z = w.steepness * w.amplitude * w.direction.y * c;
-	
-	return g;
-}
-
-void gerstnerPartials(vec3 v, Wave w, inout vec3 tangent, inout vec3 binormal)
-{
-	vec2 wDir = w.direction.xy;	// {Dx, Dz}
-	float xz = dot(v.xz, wDir);
-	float f = xz * w.frequency + time * w.phase;
-	
-	float wa = w.frequency * w.amplitude;
-	float s = sin(f);
-	float c = cos(f);
-
-	tangent += vec3(
-		-w.steepness * wDir.x * wDir.x * wa * s,
-		wDir.x * wa * c,
-		-w.steepness * wDir.x * wDir.y * wa * s
-	);
-
-	binormal += vec3(
-		-w.steepness * wDir.y * wDir.x * wa * s,
-		wDir.y * wa * c,
-		-w.steepness * wDir.y * wDir.y * wa * s
-	);
-}
-
-void sumGerstner(in vec3 v, out vec3 p, out vec3 n)
-{
-	p = v;
-	
-	// Sum displacements of all waves to get new positions
-	for (int i = 0; i < MAX_WAVES; i++)
-	{
-		p += gerstner(v, waves[i]);
-	}
-
-	vec3 tangents = vec3(1.0, 0.0, 0.0);
-	vec3 binormals = vec3(0.0, 0.0, 1.0);
-
-	// Sum partial derivatives of all waves
-	for (int i = 0; i < MAX_WAVES; i++)
+	vec2 cell = vec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+	vec2 ndc = (cell / projectedRes * 2.0 - 1.0) * (1.0 + projectedMargin);
+
+	// Unproject the cell onto the near and far planes
+	vec4 near = invViewProjection * vec4(ndc, -1.0, 1.0);
+	vec4 far = invViewProjection * vec4(ndc, 1.0, 1.0);
+	near /= near.w;
+	far /= far.w;
+
+	// Rays that miss the plane before the far plane, like those above the
+	// horizon, stop at the far plane
+	vec3 ray = far.xyz - near.xyz;
+	float t = -near.y / ray.y;
+	if (!(t >= 0.0 && t <= 1.0))
 	{
-		// Pass tangent and binormal vectors to accumulate partials
-		gerstnerPartials(v, waves[i], tangents, binormals);
+		t = 1.0;
 	}
 
-	// Calculate the normal by crossing the summed binormal and tangent vectors
-	n = normalize(cross(binormals, tangents));
+	vec3 v = near.xyz + t * ray;
+	return vec3(v.x, 0.0, v.z);
 }
 
 void main()
 {
+	vec3 v = aPos;
 	vec3 p, n;
 
-	// Sum all waves to set vertex position and normal
-	if (waveFunction == SINE)
+	if (waterGeometry == GRID)
 	{
-		sumSines(aPos, p, n);
+		v = gridPosition();
 	}
-	else if (waveFunction == STEEP_SINE)
+	else if (waterGeometry == CLIPMAP || waterGeometry == QUADTREE)
 	{
-		sumSteepSine(aPos, p, n);
+		v = levelPosition();
 	}
-	else if (waveFunction == GERSTNER)
+	else if (waterGeometry == PROJECTED)
+	{
+		v = projectedPosition();
+	}
+
+	// Sample the maps if the waves were rendered ahead of time,
+	// otherwise sum all waves to set vertex position and normal
+	if (useWaveMap || waveFunction == SPECTRAL)
 	{
-		sumGerstner(aPos, p, n);
+		sampleMaps(v, p, n);
 	}
 	else
 	{
-		p = aPos;
-		n = aNor;
+		sumWaves(waveFunction, v, p, n);
 	}
 
 	gl_Position = projection * view * model * vec4(p, 1.0);
 
 	fragPos = vec3(model * vec4(p, 1.0));
 	fragNor = normalize(vec3(model * vec4(n, 1.0)));
+	surfacePos = v;
 }
@@ -0,0 +1,18 @@
+// Displaced surface read from maps instead of summed from the waves,
+// included by the shaders that draw the water
+
+// Displacement and normal maps, from the spectral ocean or the wave map pass
+uniform sampler2D displacementMap;
+uniform sampler2D normalMap;
+uniform vec2 mapOrigin;
+uniform float mapLength;
+uniform bool useWaveMap;
+
+void sampleMaps(in vec3 v, out vec3 p, out vec3 n)
+{
+	// Texel centers sit at multiples of the texel size from the map origin
+	vec2 uv = (v.xz - mapOrigin) / mapLength + 0.5 / vec2(textureSize(displacementMap, 0));
+
+	p = v + textureLod(displacementMap, uv, 0.0).xyz;
+	n = normalize(textureLod(normalMap, uv, 0.0).xyz);
+}
@@ -0,0 +1,51 @@
+#version 420 core // For UBO binding support
+
+// Corners of the coarse patches subdivided by water.tesc and water.tese
+
+out vec3 patchPos;
+out vec3 patchNor;
+
+#include "waves.glsl"
+
+uniform int waveFunction;
+
+// Square of patches covering the plane, generated from the vertex ID
+// instead of vertex data
+uniform int patchCount;
+uniform float planeLen;
+
+#include "water_maps.glsl"
+
+
+// Every four vertices are the corners of one patch, in order around it
+// from its corner nearest the origin
+vec3 patchPosition()
+{
+	int patchIndex = gl_VertexID >> 2;
+	int corner = gl_VertexID & 3;
+	vec2 cell = vec2(patchIndex % patchCount, patchIndex / patchCount);
+	cell += vec2(corner == 1 || corner == 2, corner >= 2);
+
+	vec2 xz = cell * (planeLen / float(patchCount)) - 0.5 * planeLen;
+	return vec3(xz.x, 0.0, xz.y);
+}
+
+void main()
+{
+	vec3 v = patchPosition();
+	vec3 p, n;
+
+	// Only the normal is needed, to estimate how much the surface bends
+	// between the corners
+	if (useWaveMap || waveFunction == SPECTRAL)
+	{
+		sampleMaps(v, p, n);
+	}
+	else
+	{
+		sumWaves(waveFunction, v, p, n);
+	}
+
+	patchPos = v;
+	patchNor = n;
+}
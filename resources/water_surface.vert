@@ -0,0 +1,28 @@
+#version 420 core // For UBO binding support
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNor;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec3 fragPos;
+out vec3 fragNor;
+out vec2 texCoord;
+out vec3 surfacePos;	// Unused, the mesh is always lit with its vertex normals
+
+layout (std140, binding = 0) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+uniform mat4 model;
+
+// Passes through the plane mesh already displaced by Water::updateSurface
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+
+	fragPos = vec3(model * vec4(aPos, 1.0));
+	fragNor = normalize(vec3(model * vec4(aNor, 0.0)));
+	texCoord = aTexCoord;
+	surfacePos = aPos;
+}
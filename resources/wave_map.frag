@@ -0,0 +1,23 @@
+#version 420 core // For sampler binding support
+
+layout (location = 0) out vec4 displacement;
+layout (location = 1) out vec4 normal;
+
+#include "waves.glsl"
+
+uniform int waveFunction;
+uniform vec2 mapOrigin;
+uniform float texelLength;
+
+void main()
+{
+	// World position of this texel center on the undisplaced plane
+	vec2 xz = mapOrigin + (gl_FragCoord.xy - 0.5) * texelLength;
+	vec3 v = vec3(xz.x, 0.0, xz.y);
+
+	vec3 p, n;
+	sumWaves(waveFunction, v, p, n);
+
+	displacement = vec4(p - v, 0.0);
+	normal = vec4(n, 0.0);
+}
@@ -0,0 +1,179 @@
+// Shared wave evaluation, included by the shaders that sum the waves
+// Requires GLSL 4.20 for sampler binding support
+
+const float TWO_PI = 6.28318530718;
+
+// Wave constants at the current time
+struct WaveConstants
+{
+	vec4 wavevector;	// {Dx * frequency, Dz * frequency, Q * A * Dx, Q * A * Dz}
+	float amplitude;
+	float phase;		// time * phase
+	float steepness;
+	float wavelength;
+};
+
+// Two texels per wave, bound to WAVE_BUFFER_UNIT, laid out as WaveTexels
+// The buffer holds two wave sets, summed with their weights so a new set
+// can be faded in
+// Each set's phases are as of its upload, and are moved on by the seconds
+// elapsed since
+layout(binding = 3) uniform samplerBuffer waveBuffer;
+uniform int waveOffsets[2];
+uniform int waveCounts[2];
+uniform float waveWeights[2];
+uniform float waveElapsed[2];
+
+// Waves are sorted longest first and fade out with distance from the viewer
+// Zero or less disables the wave LOD
+uniform vec3 lodOrigin;
+uniform float lodScale;
+
+// Fetches a wave of a set, weighted and faded for the distance of the point
+// from the viewer
+// Returns false once the wave, and every shorter one after it, has faded out
+// Matches lodFade in Water.cpp
+bool fetchWave(int set, int i, float distance, out WaveConstants w)
+{
+	int texel = 2 * (waveOffsets[set] + i);
+	w.wavevector = texelFetch(waveBuffer, texel);
+	vec4 constants = texelFetch(waveBuffer, texel + 1);
+	w.wavelength = TWO_PI / length(w.wavevector.xy);
+
+	float start = w.wavelength * lodScale;
+	float fade = lodScale > 0.0 ? 1.0 - smoothstep(start, 2.0 * start, distance) : 1.0;
+	fade *= waveWeights[set];
+
+	w.wavevector.zw *= fade;
+	w.amplitude = constants.x * fade;
+	w.phase = constants.y + waveElapsed[set] * constants.w;
+	w.steepness = constants.z;
+	return fade > 0.0;
+}
+
+const int SINE = 0;
+const int STEEP_SINE = 1;
+const int GERSTNER = 2;
+const int SPECTRAL = 3;
+
+
+void sumSines(in vec3 v, out vec3 p, out vec3 n)
+{
+	// H(x, z, t) = sum of sines
+	// P(x, z, t) = [x, H(x, z, t), z]
+	p = v;
+	vec2 partials = vec2(0.0);
+
+	// Sum displacement and partial derivatives of all visible waves
+	float distance = length(v - lodOrigin);
+	for (int set = 0; set < 2; set++)
+	{
+		for (int i = 0; i < waveCounts[set]; i++)
+		{
+			WaveConstants w;
+			if (!fetchWave(set, i, distance, w))
+				break;
+
+			float f = dot(v.xz, w.wavevector.xy) + w.phase;
+
+			p.y += w.amplitude * sin(f);
+			partials += w.amplitude * w.wavevector.xy * cos(f);
+		}
+	}
+
+	// Calculate the normal by crossing the summed binormal and tangent vectors
+	// B = [0, pd/pdz{P}, 1]
+	// T = [1, pd/pdx{P}, 0]
+	// N = B x T = [-pd/pdx{P}, 1, -pd/pdz{P}]
+	n = normalize(vec3(-partials.x, 1.0, -partials.y));
+}
+
+void sumSteepSine(in vec3 v, out vec3 p, out vec3 n)
+{
+	// H(x, z, t) = sum of sines
+	// P(x, z, t) = [x, H(x, z, t), z]
+	p = v;
+	vec2 partials = vec2(0.0);
+
+	// Sum displacement and partial derivatives of all visible waves
+	float distance = length(v - lodOrigin);
+	for (int set = 0; set < 2; set++)
+	{
+		for (int i = 0; i < waveCounts[set]; i++)
+		{
+			WaveConstants w;
+			if (!fetchWave(set, i, distance, w))
+				break;
+
+			float f = dot(v.xz, w.wavevector.xy) + w.phase;
+			float base = max((sin(f) + 1.0) / 2.0, 1e-6);
+
+			// Share the power term between the height and its derivative
+			float powTerm = pow(base, w.steepness - 1.0);
+			p.y += 2.0 * w.amplitude * powTerm * base;
+			partials += w.steepness * w.amplitude * powTerm * w.wavevector.xy * cos(f);
+		}
+	}
+
+	// Calculate the normal by crossing the summed binormal and tangent vectors
+	// B = [0, pd/pdz{P}, 1]
+	// T = [1, pd/pdx{P}, 0]
+	// N = B x T = [-pd/pdx{P}, 1, -pd/pdz{P}]
+	n = normalize(vec3(-partials.x, 1.0, -partials.y));
+}
+
+void sumGerstner(in vec3 v, out vec3 p, out vec3 n)
+{
+	p = v;
+	vec3 tangents = vec3(1.0, 0.0, 0.0);
+	vec3 binormals = vec3(0.0, 0.0, 1.0);
+
+	// Sum displacements and partial derivatives of all visible waves in one pass
+	float distance = length(v - lodOrigin);
+	for (int set = 0; set < 2; set++)
+	{
+		for (int i = 0; i < waveCounts[set]; i++)
+		{
+			WaveConstants w;
+			if (!fetchWave(set, i, distance, w))
+				break;
+
+			vec2 k = w.wavevector.xy;	// D * frequency
+			vec2 qa = w.wavevector.zw;	// Q * A * D
+			float f = dot(v.xz, k) + w.phase;
+
+			float s = sin(f);
+			float c = cos(f);
+
+			p += vec3(qa.x * c, w.amplitude * s, qa.y * c);
+
+			tangents += vec3(-qa.x * k.x * s, w.amplitude * k.x * c, -qa.y * k.x * s);
+			binormals += vec3(-qa.x * k.y * s, w.amplitude * k.y * c, -qa.y * k.y * s);
+		}
+	}
+
+	// Calculate the normal by crossing the summed binormal and tangent vectors
+	n = normalize(cross(binormals, tangents));
+}
+
+// Sums all waves to get the displaced position and normal of a point
+void sumWaves(int waveFunction, in vec3 v, out vec3 p, out vec3 n)
+{
+	if (waveFunction == SINE)
+	{
+		sumSines(v, p, n);
+	}
+	else if (waveFunction == STEEP_SINE)
+	{
+		sumSteepSine(v, p, n);
+	}
+	else if (waveFunction == GERSTNER)
+	{
+		sumGerstner(v, p, n);
+	}
+	else
+	{
+		p = v;
+		n = vec3(0.0, 1.0, 0.0);
+	}
+}
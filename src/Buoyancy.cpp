@@ -0,0 +1,217 @@
+#include "Buoyancy.h"
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+// Hull points queried together by each thread
+#define BUOYANCY_CHUNK 1024
+
+
+#pragma region FloatingBody
+
+// Pose blended between the last two steps
+// The axes are blended linearly and made orthonormal again, which is close
+// enough to a slerp for the small rotations of one step
+glm::mat4 FloatingBody::getModelMatrix(float interpolation) const
+{
+	glm::vec3 p = glm::mix(previousPosition, position, interpolation);
+	glm::vec3 x = glm::normalize(glm::mix(previousOrientation[0], orientation[0], interpolation));
+	glm::vec3 y = glm::mix(previousOrientation[1], orientation[1], interpolation);
+	y = glm::normalize(y - glm::dot(y, x) * x);
+	glm::vec3 z = glm::cross(x, y);
+
+	return glm::mat4(glm::vec4(x, 0.0f), glm::vec4(y, 0.0f), glm::vec4(z, 0.0f), glm::vec4(p, 1.0f));
+}
+
+#pragma endregion
+
+
+#pragma region Buoyancy
+
+Buoyancy::Buoyancy() : heightSampler(nullptr) {}
+
+Buoyancy::~Buoyancy() {}
+
+// Adds a box of the given size at rest, with its hull sampled by a grid of
+// pointsX by pointsZ columns
+size_t Buoyancy::addBody(glm::vec3 position, glm::vec3 size, float mass,
+	int pointsX, int pointsZ)
+{
+	FloatingBody body;
+	body.position = position;
+	body.orientation = glm::mat3(1.0f);
+	body.velocity = glm::vec3(0.0f);
+	body.angularVelocity = glm::vec3(0.0f);
+	body.previousPosition = body.position;
+	body.previousOrientation = body.orientation;
+	body.size = size;
+	body.mass = mass;
+
+	// Solid box inertia
+	glm::vec3 s2 = size * size;
+	body.inertia = mass / 12.0f * glm::vec3(s2.y + s2.z, s2.x + s2.z, s2.x + s2.y);
+
+	// Place a point at the center of each column
+	body.firstPoint = hullPoints.size();
+	body.pointCount = pointsX * pointsZ;
+	for (int x = 0; x < pointsX; x++)
+	{
+		for (int z = 0; z < pointsZ; z++)
+		{
+			glm::vec3 point((x + 0.5f) / pointsX - 0.5f, 0.0f, (z + 0.5f) / pointsZ - 0.5f);
+			hullPoints.push_back(point * size);
+			probes.add(position.x + point.x * size.x, position.z + point.z * size.z);
+		}
+	}
+
+	bodies.push_back(body);
+	return bodies.size() - 1;
+}
+
+// Advances the bodies by one step, meant to be called at a fixed rate so
+// the cost of a frame only depends on how many steps it takes
+void Buoyancy::step(const Water& water, float deltaTime)
+{
+	ThreadPool* pool = ThreadPool::getInstance();
+
+	// Move the probes under the hull points, then query the water under all
+	// of them in one batch across the threads, or take the heights the GPU
+	// sampled
+	pool->parallelFor(bodies.size(), [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++)
+		{
+			const FloatingBody& body = bodies[b];
+			for (size_t i = body.firstPoint; i < body.firstPoint + body.pointCount; i++)
+			{
+				glm::vec3 point = body.position + body.orientation * hullPoints[i];
+				probes.xs[i] = point.x;
+				probes.zs[i] = point.z;
+			}
+		}
+	});
+
+	if (heightSampler != nullptr && heightSampler->isReady(probes.size()))
+	{
+		heightSampler->getHeights(probes.size(), water.getWaveTime(), probes.heights.data());
+	}
+	else
+	{
+		size_t chunks = (probes.size() + BUOYANCY_CHUNK - 1) / BUOYANCY_CHUNK;
+		pool->parallelFor(chunks, [&](size_t begin, size_t end) {
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				size_t start = chunk * BUOYANCY_CHUNK;
+				size_t count = std::min((size_t)BUOYANCY_CHUNK, probes.size() - start);
+				water.getSurfaceHeights(probes.xs.data() + start, probes.zs.data() + start, count,
+					probes.heights.data() + start, probes.guessXs.data() + start,
+					probes.guessZs.data() + start);
+			}
+		});
+	}
+
+	// Sum the forces and torques on each body and integrate them
+	pool->parallelFor(bodies.size(), [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; b++)
+		{
+			FloatingBody& body = bodies[b];
+			glm::mat3& r = body.orientation;
+
+			glm::vec3 force(0.0f, -GRAVITY * body.mass, 0.0f);
+			glm::vec3 torque(0.0f);
+
+			float columnArea = body.size.x * body.size.z / body.pointCount;
+			float columnMass = body.mass / body.pointCount;
+			for (size_t i = body.firstPoint; i < body.firstPoint + body.pointCount; i++)
+			{
+				glm::vec3 arm = r * hullPoints[i];
+
+				// Depth of the column below the surface, measured from the
+				// bottom of the hull along its tilted up axis
+				float bottom = body.position.y + arm.y - 0.5f * body.size.y * r[1].y;
+				float depth = glm::clamp(probes.heights[i] - bottom, 0.0f, body.size.y);
+				if (depth <= 0.0f)
+				{
+					continue;
+				}
+
+				// Archimedes' force, and drag on the submerged part of the column
+				glm::vec3 pointVelocity = body.velocity + glm::cross(body.angularVelocity, arm);
+				glm::vec3 pointForce(0.0f, WATER_DENSITY * GRAVITY * columnArea * depth, 0.0f);
+				pointForce -= BUOYANCY_DRAG * columnMass * (depth / body.size.y) * pointVelocity;
+
+				force += pointForce;
+				torque += glm::cross(arm, pointForce);
+			}
+
+			body.previousPosition = body.position;
+			body.previousOrientation = r;
+
+			// Semi-implicit Euler
+			body.velocity += force / body.mass * deltaTime;
+			body.position += body.velocity * deltaTime;
+
+			// Apply the inverse inertia in body space
+			glm::vec3 bodyTorque(glm::dot(r[0], torque), glm::dot(r[1], torque), glm::dot(r[2], torque));
+			glm::vec3 bodyAcceleration = bodyTorque / body.inertia;
+			body.angularVelocity += r * bodyAcceleration * deltaTime;
+
+			// Rotate the axes and keep them orthonormal
+			for (int axis = 0; axis < 3; axis++)
+			{
+				r[axis] += glm::cross(body.angularVelocity, r[axis]) * deltaTime;
+			}
+			r[0] = glm::normalize(r[0]);
+			r[1] = glm::normalize(r[1] - glm::dot(r[1], r[0]) * r[0]);
+			r[2] = glm::cross(r[0], r[1]);
+		}
+	});
+}
+
+size_t Buoyancy::getBodyCount() const
+{
+	return bodies.size();
+}
+
+// FNV-1a hash of the state of all bodies, for checking that two runs match
+// bit for bit
+unsigned long long Buoyancy::getStateHash() const
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (const FloatingBody& body : bodies)
+	{
+		const void* fields[4] = { &body.position, &body.orientation, &body.velocity, &body.angularVelocity };
+		size_t sizes[4] = { sizeof(body.position), sizeof(body.orientation),
+			sizeof(body.velocity), sizeof(body.angularVelocity) };
+
+		for (int f = 0; f < 4; f++)
+		{
+			const unsigned char* bytes = (const unsigned char*)fields[f];
+			for (size_t i = 0; i < sizes[f]; i++)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+	}
+	return hash;
+}
+
+const FloatingBody& Buoyancy::getBody(size_t index) const
+{
+	return bodies[index];
+}
+
+const SurfaceProbes& Buoyancy::getProbes() const
+{
+	return probes;
+}
+
+// Takes the heights from the GPU instead of the CPU queries, or goes back to
+// the CPU queries when null
+// The GPU heights arrive frames late and depend on the frame timing, so runs
+// using them do not replay exactly
+void Buoyancy::setHeightSampler(const HeightSampler* heightSampler)
+{
+	this->heightSampler = heightSampler;
+}
+
+#pragma endregion
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef BUOYANCY_H
+#define BUOYANCY_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Water.h"
+#include "HeightSampler.h"
+
+#define WATER_DENSITY 1025.0f
+#define GRAVITY 9.81f
+
+// Rate at which submerged hull points lose their velocity, per second
+#define BUOYANCY_DRAG 1.5f
+
+
+// Rigid box floating on the water, sampled at a grid of hull points
+// Each point stands for a vertical column of the box, pushed up by the
+// weight of the water it displaces
+struct FloatingBody
+{
+	glm::vec3 position;			// Center of mass
+	glm::mat3 orientation;		// Body to world rotation
+	glm::vec3 velocity;
+	glm::vec3 angularVelocity;	// World space, in radians per second
+
+	// Pose before the last step, for drawing between steps
+	glm::vec3 previousPosition;
+	glm::mat3 previousOrientation;
+
+	glm::vec3 size;
+	float mass;
+	glm::vec3 inertia;			// Diagonal of the body space inertia tensor
+
+	size_t firstPoint, pointCount;
+
+	glm::mat4 getModelMatrix(float interpolation = 1.0f) const;
+};
+
+class Buoyancy
+{
+public:
+	Buoyancy();
+	~Buoyancy();
+
+	size_t addBody(glm::vec3 position, glm::vec3 size, float mass,
+		int pointsX = 2, int pointsZ = 2);
+	void step(const Water& water, float deltaTime);
+
+	void setHeightSampler(const HeightSampler* heightSampler);
+
+	size_t getBodyCount() const;
+	unsigned long long getStateHash() const;
+	const FloatingBody& getBody(size_t index) const;
+	const SurfaceProbes& getProbes() const;
+
+private:
+	std::vector<FloatingBody> bodies;
+
+	// Hull points of all bodies, in body space, and the water under them
+	std::vector<glm::vec3> hullPoints;
+	SurfaceProbes probes;
+
+	// Heights read back from the GPU, used instead of the CPU queries once
+	// they cover every hull point
+	const HeightSampler* heightSampler;
+};
+
+#endif // BUOYANCY_H
@@ -81,6 +81,22 @@ glm::mat4 Camera::getViewMatrix() const
 	return glm::lookAt(position, position + front, up);
 }
 
+glm::mat4 Camera::getProjectionMatrix() const
+{
+	float aspect = (float)(*screenWidth) / (*screenHeight);
+	return glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+}
+
+int Camera::getScreenWidth() const
+{
+	return *screenWidth;
+}
+
+int Camera::getScreenHeight() const
+{
+	return *screenHeight;
+}
+
 void Camera::setupMatricesUbo()
 {
 	// Initialize UBO and allocate memory for two matrices
@@ -93,8 +109,7 @@ void Camera::setupMatricesUbo()
 	glBindBufferRange(GL_UNIFORM_BUFFER, 0, matricesUboID, 0, 2 * sizeof(glm::mat4));
 
 	// Store the projection matrix
-	float aspect = (float)(*screenWidth) / (*screenHeight);
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+	glm::mat4 projection = getProjectionMatrix();
 	glBindBuffer(GL_UNIFORM_BUFFER, matricesUboID);
 	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projection));
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
@@ -110,8 +125,7 @@ void Camera::setupMatricesUbo()
 void Camera::updatePerspective()
 {
 	// Update the projection matrix
-	float aspect = (float)(*screenWidth) / (*screenHeight);
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
+	glm::mat4 projection = getProjectionMatrix();
 	glBindBuffer(GL_UNIFORM_BUFFER, matricesUboID);
 	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projection));
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
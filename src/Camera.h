@@ -21,6 +21,9 @@ public:
 
 	glm::vec3 getPosition() const;
 	glm::mat4 getViewMatrix() const;
+	glm::mat4 getProjectionMatrix() const;
+	int getScreenWidth() const;
+	int getScreenHeight() const;
 	void setupMatricesUbo();
 	void updatePerspective();
 	void updateView();
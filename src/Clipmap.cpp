@@ -0,0 +1,93 @@
+#include "Clipmap.h"
+
+#include <cmath>
+
+
+Clipmap::Clipmap() : levels(CLIPMAP_LEVELS), resolution(CLIPMAP_RES), 
+	spacing(0.1f), vaoID(0) {}
+
+Clipmap::Clipmap(int levels, int resolution, float spacing) 
+	: levels(levels), resolution(resolution), spacing(spacing), vaoID(0) {}
+
+Clipmap::~Clipmap() {}
+
+void Clipmap::init()
+{
+	// The grids are generated from gl_VertexID and gl_InstanceID,
+	// but core profiles still need a vertex array bound to draw
+	if (vaoID == 0)
+	{
+		glGenVertexArrays(1, &vaoID);
+	}
+}
+
+void Clipmap::draw(const Shader& shader, glm::vec3 viewerPosition) const
+{
+	glm::vec2 viewer(viewerPosition.x, viewerPosition.z);
+	float n = (float)resolution;
+	float quarter = (float)(resolution / 4);
+
+	glBindVertexArray(vaoID);
+	shader.setVec3("morphViewer", viewerPosition);
+
+	glm::vec2 innerCenter(0.0f);
+	for (int level = 0; level < levels; level++)
+	{
+		float levelSpacing = spacing * (float)(1 << level);
+
+		// Snap the center to every other vertex, so the odd vertices that
+		// morph onto the coarser level stay the same as the viewer moves
+		// Kept in whole cells, so shared vertices of neighboring levels
+		// come out bit identical
+		glm::vec2 center = glm::floor(viewer / (2.0f * levelSpacing)) * 2.0f;
+
+		// Morph between the farthest the hole edge can be from the viewer
+		// and the nearest the outer edge can be
+		glm::vec2 morphRange = glm::vec2(quarter + 1.0f, 2.0f * quarter - 2.0f) * levelSpacing;
+
+		shader.setVec2("levelOrigin", center - 0.5f * n);
+		shader.setFloat("levelSpacing", levelSpacing);
+		shader.setVec2("morphRange", morphRange);
+
+		if (level == 0)
+		{
+			drawBlock(shader, glm::vec2(0.0f), glm::vec2(n));
+		}
+		else
+		{
+			// The finer level covers the middle half of this one, offset by
+			// up to one cell since it snaps to half the spacing
+			glm::vec2 hole0 = 0.5f * innerCenter - center + quarter;
+			glm::vec2 hole1 = hole0 + 2.0f * quarter;
+
+			// Draw the ring as the rows below and above the hole,
+			// and the columns on either side of it
+			drawBlock(shader, glm::vec2(0.0f), glm::vec2(n, hole0.y));
+			drawBlock(shader, glm::vec2(0.0f, hole1.y), glm::vec2(n, n - hole1.y));
+			drawBlock(shader, glm::vec2(0.0f, hole0.y), glm::vec2(hole0.x, hole1.y - hole0.y));
+			drawBlock(shader, glm::vec2(hole1.x, hole0.y), glm::vec2(n - hole1.x, hole1.y - hole0.y));
+		}
+
+		innerCenter = center;
+	}
+
+	glBindVertexArray(0);
+}
+
+// Draws a block of cells, one instance per row
+void Clipmap::drawBlock(const Shader& shader, glm::vec2 start, glm::vec2 size) const
+{
+	shader.setVec2("blockStart", start);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * ((int)size.x + 1), (int)size.y);
+}
+
+int Clipmap::getLevels() const
+{
+	return levels;
+}
+
+// Distance from the center to the edge of the coarsest level
+float Clipmap::getExtent() const
+{
+	return 0.5f * resolution * spacing * (float)(1 << (levels - 1));
+}
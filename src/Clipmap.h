@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef CLIPMAP_H
+#define CLIPMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+#define CLIPMAP_LEVELS 9
+#define CLIPMAP_RES 64		// Quads per side of each level, a multiple of 4
+
+
+// Geometry clipmap of nested square grids that follow the viewer
+// Each level doubles the grid spacing of the one inside it and leaves a hole
+// where the finer level is drawn. The grids are generated in the vertex shader,
+// so a level is only a set of uniforms and an instanced draw per block of
+// the ring around the hole.
+// Vertices near the outer edge of a level slide onto the coarser grid,
+// so neighboring levels meet without cracks or popping
+class Clipmap
+{
+public:
+	Clipmap();
+	Clipmap(int levels, int resolution, float spacing);
+	~Clipmap();
+
+	void init();
+	void draw(const Shader& shader, glm::vec3 viewerPosition) const;
+
+	int getLevels() const;
+	float getExtent() const;
+
+private:
+	void drawBlock(const Shader& shader, glm::vec2 start, glm::vec2 size) const;
+
+	int levels;
+	int resolution;
+	float spacing;		// Grid spacing of the finest level
+
+	GLuint vaoID;
+};
+
+#endif // CLIPMAP_H
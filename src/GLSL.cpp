@@ -167,4 +167,66 @@ void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean
 	}
 }
 
+static PFNGLPATCHPARAMETERIPROC patchParameteriProc = nullptr;
+
+// Loads the tessellation entry point if the context is GL 4.0 or later
+// Returns whether tessellation shaders can be used
+bool loadTessellation(GLADloadproc load)
+{
+	GLint major = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	if (major < 4)
+	{
+		return false;
+	}
+
+	patchParameteriProc = (PFNGLPATCHPARAMETERIPROC)load("glPatchParameteri");
+	return patchParameteriProc != nullptr;
+}
+
+bool supportsTessellation()
+{
+	return patchParameteriProc != nullptr;
+}
+
+void patchParameteri(GLenum pname, GLint value)
+{
+	if (patchParameteriProc != nullptr)
+	{
+		patchParameteriProc(pname, value);
+	}
+}
+
+static PFNGLBUFFERSTORAGEPROC bufferStorageProc = nullptr;
+
+// Loads the immutable buffer storage entry point if the context is GL 4.4
+// or later
+// Returns whether buffers can be mapped persistently
+bool loadBufferStorage(GLADloadproc load)
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major < 4 || (major == 4 && minor < 4))
+	{
+		return false;
+	}
+
+	bufferStorageProc = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+	return bufferStorageProc != nullptr;
+}
+
+bool supportsBufferStorage()
+{
+	return bufferStorageProc != nullptr;
+}
+
+void bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	if (bufferStorageProc != nullptr)
+	{
+		bufferStorageProc(target, size, data, flags);
+	}
+}
+
 }
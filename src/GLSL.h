@@ -11,6 +11,24 @@
 #include <glad/glad.h>
 #include <string>
 
+// Tessellation is core in GL 4.0, past the 3.3 loader, so its enums and
+// entry point are declared here and loaded by hand
+#ifndef GL_PATCHES
+#define GL_PATCHES 0x000E
+#define GL_PATCH_VERTICES 0x8E72
+#define GL_TESS_EVALUATION_SHADER 0x8E87
+#define GL_TESS_CONTROL_SHADER 0x8E88
+typedef void (APIENTRYP PFNGLPATCHPARAMETERIPROC)(GLenum pname, GLint value);
+#endif
+
+// Immutable buffer storage is core in GL 4.4, and is loaded the same way for
+// persistently mapped buffers
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size,
+	const void* data, GLbitfield flags);
+#endif
 
 namespace GLSL
 {
@@ -25,6 +43,12 @@ namespace GLSL
 	void enableVertexAttribArray(const GLint handle);
 	void disableVertexAttribArray(const GLint handle);
 	void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+	bool loadTessellation(GLADloadproc load);
+	bool supportsTessellation();
+	void patchParameteri(GLenum pname, GLint value);
+	bool loadBufferStorage(GLADloadproc load);
+	bool supportsBufferStorage();
+	void bufferStorage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
 }
 
 
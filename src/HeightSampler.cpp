@@ -0,0 +1,234 @@
+#include "HeightSampler.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+
+HeightSampler::HeightSampler() :
+	capacity(0), rows(0), fboID(0), heightTexID(0), vaoID(0), positionsVboID(0),
+	nextReadback(0), heightsTime(0.0), previousTime(0.0), heightsCount(0)
+{
+	for (Readback& readback : readbacks)
+	{
+		readback = { 0, nullptr, 0, 0.0 };
+	}
+}
+
+HeightSampler::~HeightSampler() {}
+
+bool HeightSampler::init(const std::string& vShaderFile, const std::string& fShaderFile, int capacity)
+{
+	if (capacity <= 0)
+	{
+		std::cerr << "Height sampler needs at least one point" << std::endl;
+		return false;
+	}
+
+	this->capacity = capacity;
+	rows = (capacity + HEIGHT_SAMPLER_WIDTH - 1) / HEIGHT_SAMPLER_WIDTH;
+
+	if (!shader.init(vShaderFile, fShaderFile))
+	{
+		return false;
+	}
+
+	// One float target texel per point
+	glGenTextures(1, &heightTexID);
+	glBindTexture(GL_TEXTURE_2D, heightTexID);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, HEIGHT_SAMPLER_WIDTH, rows, 0,
+		GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previousFbo;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+
+	glGenFramebuffers(1, &fboID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboID);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, heightTexID, 0);
+
+	bool complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFbo);
+
+	if (!complete)
+	{
+		std::cerr << "Height sampler framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	// Each point is drawn from its (x, z) position, and lands on the pixel
+	// of its index
+	glGenVertexArrays(1, &vaoID);
+	glBindVertexArray(vaoID);
+	glGenBuffers(1, &positionsVboID);
+	glBindBuffer(GL_ARRAY_BUFFER, positionsVboID);
+	glBufferData(GL_ARRAY_BUFFER, capacity * 2 * sizeof(float), nullptr, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Pixel buffers the heights are copied into
+	size_t readbackSize = HEIGHT_SAMPLER_WIDTH * rows * sizeof(float);
+	for (Readback& readback : readbacks)
+	{
+		glGenBuffers(1, &readback.pboID);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pboID);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return true;
+}
+
+// Samples the heights under the points with the waves last sent to the GPU,
+// which were folded at the given wave time
+// Returns false without sampling when every readback is still in flight
+bool HeightSampler::request(const Water& water, const float* xs, const float* zs,
+	size_t count, double time)
+{
+	count = std::min(count, (size_t)capacity);
+	Readback& readback = readbacks[nextReadback];
+	if (count == 0 || readback.fence != nullptr)
+		return false;
+
+	// Interleave the positions into the orphaned vertex buffer
+	std::vector<float> positions(count * 2);
+	for (size_t i = 0; i < count; i++)
+	{
+		positions[2 * i] = xs[i];
+		positions[2 * i + 1] = zs[i];
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, positionsVboID);
+	glBufferData(GL_ARRAY_BUFFER, capacity * 2 * sizeof(float), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, positions.size() * sizeof(float), positions.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Save the state changed by the pass
+	GLint previousFbo, previousReadFbo, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFbo);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+	glViewport(0, 0, HEIGHT_SAMPLER_WIDTH, rows);
+	glDisable(GL_DEPTH_TEST);
+
+	// The summed waves are read from the wave buffer, the spectral ocean
+	// from its displacement map
+	water.bindWavesBuffer(WAVE_BUFFER_UNIT);
+	const Spectrum& spectrum = water.getSpectrum();
+	if (water.getWaveFunction() == SPECTRAL)
+	{
+		spectrum.bindTextures(DISPLACEMENT_MAP_UNIT, NORMAL_MAP_UNIT);
+	}
+
+	shader.bind();
+	shader.setInt("waveFunction", water.getWaveFunction());
+	water.setWaveUniforms(shader);
+	shader.setVec3("lodOrigin", glm::vec3(0.0f));
+	shader.setFloat("lodScale", 0.0f);
+	shader.setInt("displacementMap", DISPLACEMENT_MAP_UNIT);
+	shader.setFloat("mapLength", spectrum.getLength());
+	shader.setInt("iterations", HEIGHT_SAMPLER_ITERATIONS);
+	shader.setVec2("targetSize", glm::vec2(HEIGHT_SAMPLER_WIDTH, rows));
+
+	glBindVertexArray(vaoID);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+	glBindVertexArray(0);
+
+	shader.unbind();
+
+	// Copy the heights into the pixel buffer, which returns at once, and
+	// fence the copy
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pboID);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, HEIGHT_SAMPLER_WIDTH, rows, GL_RED, GL_FLOAT, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.count = count;
+	readback.time = time;
+	nextReadback = (nextReadback + 1) % HEIGHT_READBACKS;
+
+	// Restore the previous state
+	if (depthTest)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFbo);
+
+	return true;
+}
+
+// Reads back every readback the GPU has finished, oldest first, without
+// waiting on the ones still in flight
+// Returns true if new heights arrived
+bool HeightSampler::collect()
+{
+	bool collected = false;
+
+	for (int i = 0; i < HEIGHT_READBACKS; i++)
+	{
+		Readback& readback = readbacks[(nextReadback + i) % HEIGHT_READBACKS];
+		if (readback.fence == nullptr)
+			continue;
+
+		GLenum status = glClientWaitSync(readback.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(readback.fence);
+		readback.fence = nullptr;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pboID);
+		const float* mapped = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			readback.count * sizeof(float), GL_MAP_READ_BIT);
+		if (mapped != nullptr)
+		{
+			std::swap(heights, previousHeights);
+			previousTime = heightsTime;
+
+			heights.assign(mapped, mapped + readback.count);
+			heightsTime = readback.time;
+			heightsCount = readback.count;
+			collected = true;
+
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	return collected;
+}
+
+bool HeightSampler::isReady(size_t count) const
+{
+	return heightsCount == count;
+}
+
+// Heights at a wave time, extrapolated from the last two readbacks, since
+// they were sampled a frame or two earlier
+// Falls back to the last heights until there are two readbacks of the
+// same points
+void HeightSampler::getHeights(size_t count, double time, float* out) const
+{
+	count = std::min(count, heightsCount);
+
+	bool extrapolate = previousHeights.size() == heights.size() && heightsTime > previousTime;
+	float scale = extrapolate ? (float)((time - heightsTime) / (heightsTime - previousTime)) : 0.0f;
+
+	// Never reach further ahead than the readbacks in flight
+	scale = glm::clamp(scale, 0.0f, (float)HEIGHT_READBACKS);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = heights[i] + (extrapolate ? scale * (heights[i] - previousHeights[i]) : 0.0f);
+	}
+}
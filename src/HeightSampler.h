@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef HEIGHT_SAMPLER_H
+#define HEIGHT_SAMPLER_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include "Shader.h"
+#include "Water.h"
+
+// Points sampled per row of the height target
+#define HEIGHT_SAMPLER_WIDTH 256
+
+// Readbacks in flight, so each one is read a frame or two after it was
+// requested instead of stalling on the GPU
+#define HEIGHT_READBACKS 3
+
+// Fixed-point iterations per point, more than the CPU takes since no guess
+// carries over from the last readback
+#define HEIGHT_SAMPLER_ITERATIONS 8
+
+
+// Samples the water heights under a set of points on the GPU, one pixel per
+// point, for when the GPU is the authority on the wave field
+// The heights are copied into a ring of pixel buffers guarded by fences and
+// read back once the GPU is done with them, then extrapolated from the last
+// two readbacks to make up for their latency
+class HeightSampler
+{
+public:
+	HeightSampler();
+	~HeightSampler();
+
+	bool init(const std::string& vShaderFile, const std::string& fShaderFile, int capacity);
+	bool request(const Water& water, const float* xs, const float* zs, size_t count, double time);
+	bool collect();
+
+	bool isReady(size_t count) const;
+	void getHeights(size_t count, double time, float* heights) const;
+
+private:
+	struct Readback
+	{
+		GLuint pboID;
+		GLsync fence;	// Null when the buffer is free
+		size_t count;
+		double time;	// Wave time the heights were sampled at
+	};
+
+	int capacity, rows;
+
+	Shader shader;
+	GLuint fboID, heightTexID;
+	GLuint vaoID, positionsVboID;
+
+	Readback readbacks[HEIGHT_READBACKS];
+	int nextReadback;
+
+	// The last two heights read back and when they were sampled
+	std::vector<float> heights, previousHeights;
+	double heightsTime, previousTime;
+	size_t heightsCount;
+};
+
+#endif // HEIGHT_SAMPLER_H
@@ -25,6 +25,18 @@ void HierarchyNode::drawHierarchyFromRoot(glm::vec3 lightDir, glm::vec3 cameraPo
 	}
 }
 
+// Draws the hierarchy with the root placed relative to a parent transform
+void HierarchyNode::drawHierarchyFromRoot(glm::mat4 parentModel, glm::vec3 lightDir, glm::vec3 cameraPos)
+{
+	glm::mat4 model = parentModel * gameObject->transform.getCompositeTransform();
+
+	// Recursively draw the children
+	for (HierarchyNode* child : children)
+	{
+		child->drawHierarchy(model, lightDir, cameraPos);
+	}
+}
+
 void HierarchyNode::drawHierarchy(glm::mat4 parentModel, glm::vec3 lightDir, glm::vec3 cameraPos)
 {
 	// Compose the model matrix for the current node
@@ -22,6 +22,7 @@ public:
 
 	void addChild(HierarchyNode* child);
 	void drawHierarchyFromRoot(glm::vec3 lightDir, glm::vec3 cameraPos);
+	void drawHierarchyFromRoot(glm::mat4 parentModel, glm::vec3 lightDir, glm::vec3 cameraPos);
 	void drawHierarchy(glm::mat4 parentModel, glm::vec3 lightDir, glm::vec3 cameraPos);
 	void clearHierarchy();
 };
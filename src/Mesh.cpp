@@ -1,10 +1,14 @@
 #include "Mesh.h"
 
 #include <iostream>
+#include <deque>
+#include <algorithm>
 #include "GLSL.h"
 
 Mesh::Mesh() : vaoID(0), vboID(0), eboID(0), 
-	vertUsage(GL_STATIC_DRAW), numIndices(0) {};
+	vertUsage(GL_STATIC_DRAW), numIndices(0), numVertices(0),
+	streaming(false), streamRegion(0), texCoordVboID(0), streamFences(),
+	persistentVertices(nullptr) {};
 
 Mesh::~Mesh() {}
 
@@ -13,9 +17,16 @@ void Mesh::setDynamic(bool isDynamic)
 	vertUsage = isDynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
 }
 
-void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
-	std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords,
-	std::vector<unsigned int>& indices)
+// Streaming meshes are written through mapVertices every frame instead of
+// updateBuffers, without waiting on the GPU
+// Must be set before the buffers are set up
+void Mesh::setStreaming(bool isStreaming)
+{
+	streaming = isStreaming;
+}
+
+void Mesh::setupVertices(std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords)
 {
 	// Generate and initialize the vertex array object
 	CHECKED_GL_CALL(glGenVertexArrays(1, &vaoID));
@@ -24,6 +35,13 @@ void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
 	// Generate and bind the vertex buffer object
 	CHECKED_GL_CALL(glGenBuffers(1, &vboID));
 	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vboID));
+	numVertices = positions.size();
+
+	if (streaming)
+	{
+		setupStreamingVertices(positions, normals, texCoords);
+		return;
+	}
 
 	// Allocate space for the data in a single buffer
 	vertBuf.resize(positions.size() * VERTEX_ATTRIBUTES);
@@ -70,7 +88,94 @@ void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
 		CHECKED_GL_CALL(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
 			stride, (void*)offset));
 	}
-	
+}
+
+// Allocates every region with the initial positions and normals, and a
+// separate static buffer for the texture coordinates
+// With GL 4.4 the regions are mapped once and stay mapped, otherwise each
+// frame maps its region, see mapVertices
+void Mesh::setupStreamingVertices(std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords)
+{
+	size_t regionSize = numVertices * STREAM_ATTRIBUTES * sizeof(float);
+	if (GLSL::supportsBufferStorage())
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		CHECKED_GL_CALL(GLSL::bufferStorage(GL_ARRAY_BUFFER, STREAM_REGIONS * regionSize,
+			nullptr, flags));
+		persistentVertices = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+			STREAM_REGIONS * regionSize, flags);
+
+		// Immutable storage cannot be orphaned or mapped per frame, so start
+		// over with a mutable buffer
+		if (persistentVertices == nullptr)
+		{
+			std::cerr << "Failed to map the vertex buffer persistently" << std::endl;
+			CHECKED_GL_CALL(glDeleteBuffers(1, &vboID));
+			CHECKED_GL_CALL(glGenBuffers(1, &vboID));
+			CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vboID));
+		}
+	}
+	if (persistentVertices == nullptr)
+	{
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, STREAM_REGIONS * regionSize,
+			nullptr, GL_STREAM_DRAW));
+	}
+
+	std::vector<float> region(numVertices * STREAM_ATTRIBUTES);
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		size_t index = STREAM_ATTRIBUTES * i;
+		region[index] = positions[i].x;
+		region[index + 1] = positions[i].y;
+		region[index + 2] = positions[i].z;
+		region[index + 3] = normals[i].x;
+		region[index + 4] = normals[i].y;
+		region[index + 5] = normals[i].z;
+	}
+	for (int r = 0; r < STREAM_REGIONS; r++)
+	{
+		if (persistentVertices != nullptr)
+		{
+			std::copy(region.begin(), region.end(),
+				persistentVertices + r * region.size());
+		}
+		else
+		{
+			CHECKED_GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, r * regionSize,
+				regionSize, region.data()));
+		}
+	}
+	streamRegion = 0;
+
+	// Enable position and normal attribute pointers into the first region
+	size_t stride = STREAM_ATTRIBUTES * sizeof(float);
+	CHECKED_GL_CALL(glEnableVertexAttribArray(0));
+	CHECKED_GL_CALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+		stride, (void*)0));
+	CHECKED_GL_CALL(glEnableVertexAttribArray(1));
+	CHECKED_GL_CALL(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+		stride, (void*)(3 * sizeof(float))));
+
+	// Enable texture attribute pointer if available
+	if (!texCoords.empty())
+	{
+		CHECKED_GL_CALL(glGenBuffers(1, &texCoordVboID));
+		CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, texCoordVboID));
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(glm::vec2),
+			texCoords.data(), GL_STATIC_DRAW));
+		CHECKED_GL_CALL(glEnableVertexAttribArray(2));
+		CHECKED_GL_CALL(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE,
+			sizeof(glm::vec2), (void*)0));
+	}
+}
+
+void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords,
+	std::vector<unsigned int>& indices)
+{
+	setupVertices(positions, normals, texCoords);
+
 	// Generate and initialize the element buffer object
 	numIndices = indices.size();
 	CHECKED_GL_CALL(glGenBuffers(1, &eboID));
@@ -82,6 +187,36 @@ void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
 	CHECKED_GL_CALL(glBindVertexArray(0));
 }
 
+// Sets up triangle strips separated by PRIMITIVE_RESTART_INDEX, with 16-bit
+// indices relative to the base vertex of each tile
+void Mesh::setupBuffers(std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords,
+	std::vector<unsigned short>& indices, const std::vector<IndexTile>& tiles)
+{
+	setupVertices(positions, normals, texCoords);
+
+	// Generate and initialize the element buffer object
+	numIndices = indices.size();
+	CHECKED_GL_CALL(glGenBuffers(1, &eboID));
+	CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID));
+	CHECKED_GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		numIndices * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW));
+
+	// Store the draw arguments of each tile for a single multi-draw
+	tileCounts.clear();
+	tileOffsets.clear();
+	tileBaseVertices.clear();
+	for (const IndexTile& tile : tiles)
+	{
+		tileCounts.push_back(tile.count);
+		tileOffsets.push_back((const void*)(tile.offset * sizeof(unsigned short)));
+		tileBaseVertices.push_back(tile.baseVertex);
+	}
+
+	// Unbind the vertex array object
+	CHECKED_GL_CALL(glBindVertexArray(0));
+}
+
 void Mesh::setupBuffers(const tinyobj::shape_t& shape)
 {
 	// Generate and initialize the vertex array object
@@ -154,15 +289,36 @@ void Mesh::setupBuffers(const tinyobj::shape_t& shape)
 void Mesh::updateBuffers(std::vector<glm::vec3>& positions, 
 	std::vector<glm::vec3>& normals)
 {
-	// Update the vertex data
-	for (size_t i = 0; i < vertBuf.size(); i += VERTEX_ATTRIBUTES)
+	if (streaming)
 	{
-		vertBuf[i] = positions[i].x;
-		vertBuf[i + 1] = positions[i].y;
-		vertBuf[i + 2] = positions[i].z;
-		vertBuf[i + 3] = normals[i].x;
-		vertBuf[i + 4] = normals[i].y;
-		vertBuf[i + 5] = normals[i].z;
+		float* region = mapVertices();
+		if (region == nullptr)
+			return;
+
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			size_t index = STREAM_ATTRIBUTES * i;
+			region[index] = positions[i].x;
+			region[index + 1] = positions[i].y;
+			region[index + 2] = positions[i].z;
+			region[index + 3] = normals[i].x;
+			region[index + 4] = normals[i].y;
+			region[index + 5] = normals[i].z;
+		}
+		unmapVertices();
+		return;
+	}
+
+	// Update the vertex data, leaving the texture coordinates in place
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		size_t index = VERTEX_ATTRIBUTES * i;
+		vertBuf[index] = positions[i].x;
+		vertBuf[index + 1] = positions[i].y;
+		vertBuf[index + 2] = positions[i].z;
+		vertBuf[index + 3] = normals[i].x;
+		vertBuf[index + 4] = normals[i].y;
+		vertBuf[index + 5] = normals[i].z;
 	}
 
 	// Bind the vertex buffer object and update the buffer data
@@ -171,6 +327,103 @@ void Mesh::updateBuffers(std::vector<glm::vec3>& positions,
 		vertBuf.size() * sizeof(float), vertBuf.data()));
 }
 
+// Maps the next region of a streaming mesh, to be filled with
+// STREAM_ATTRIBUTES floats of position and normal per vertex
+// Only waits if the GPU is still drawing from the region, which was last
+// drawn STREAM_REGIONS - 1 frames ago
+float* Mesh::mapVertices()
+{
+	streamRegion = (streamRegion + 1) % STREAM_REGIONS;
+	waitForRegion(streamRegion);
+
+	// Persistently mapped regions are written in place, and are coherent so
+	// they need no flush
+	size_t regionSize = numVertices * STREAM_ATTRIBUTES * sizeof(float);
+	if (persistentVertices != nullptr)
+	{
+		return persistentVertices + streamRegion * numVertices * STREAM_ATTRIBUTES;
+	}
+
+	// The fence already guarantees the region is free, so skip the driver's sync
+	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vboID));
+	void* region = glMapBufferRange(GL_ARRAY_BUFFER, streamRegion * regionSize, regionSize,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+	// Fall back to orphaning the whole buffer, leaving only this region valid
+	// The other regions' fences guard storage that is gone
+	if (region == nullptr)
+	{
+		deleteStreamFences();
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, STREAM_REGIONS * regionSize,
+			nullptr, GL_STREAM_DRAW));
+		region = glMapBufferRange(GL_ARRAY_BUFFER, streamRegion * regionSize, regionSize,
+			GL_MAP_WRITE_BIT);
+	}
+
+	if (region == nullptr)
+	{
+		std::cerr << "Failed to map the vertex buffer" << std::endl;
+	}
+	return (float*)region;
+}
+
+// Blocks until the GPU has finished drawing from a region
+// If the wait itself fails, finishes all GPU work instead
+void Mesh::waitForRegion(int region)
+{
+	GLsync& fence = streamFences[region];
+	if (fence == 0)
+		return;
+
+	GLenum status;
+	do
+	{
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_WAIT_NS);
+	} while (status == GL_TIMEOUT_EXPIRED);
+
+	if (status == GL_WAIT_FAILED)
+	{
+		std::cerr << "Failed to wait for the vertex buffer region" << std::endl;
+		CHECKED_GL_CALL(glFinish());
+	}
+
+	CHECKED_GL_CALL(glDeleteSync(fence));
+	fence = 0;
+}
+
+void Mesh::deleteStreamFences()
+{
+	for (GLsync& fence : streamFences)
+	{
+		if (fence != 0)
+		{
+			CHECKED_GL_CALL(glDeleteSync(fence));
+			fence = 0;
+		}
+	}
+}
+
+// Unmaps the region filled since mapVertices, unless the regions stay mapped,
+// and draws from it
+void Mesh::unmapVertices()
+{
+	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vboID));
+	if (persistentVertices == nullptr && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+	{
+		std::cerr << "Vertex buffer was corrupted while mapped" << std::endl;
+	}
+
+	// Point the positions and normals at the new region
+	size_t stride = STREAM_ATTRIBUTES * sizeof(float);
+	size_t offset = streamRegion * numVertices * stride;
+	CHECKED_GL_CALL(glBindVertexArray(vaoID));
+	CHECKED_GL_CALL(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+		stride, (void*)offset));
+	CHECKED_GL_CALL(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+		stride, (void*)(offset + 3 * sizeof(float))));
+	CHECKED_GL_CALL(glBindVertexArray(0));
+}
+
 void Mesh::generateBBox(std::vector<glm::vec3>& positions)
 {
 	// Initialize the bounding box with extreme values
@@ -213,7 +466,70 @@ BBox Mesh::getBBox() const
 void Mesh::draw() const
 {
 	CHECKED_GL_CALL(glBindVertexArray(vaoID));
-	CHECKED_GL_CALL(glDrawElements(GL_TRIANGLES, numIndices, 
-		GL_UNSIGNED_INT, (const void*)0));
+	if (tileCounts.empty())
+	{
+		CHECKED_GL_CALL(glDrawElements(GL_TRIANGLES, numIndices, 
+			GL_UNSIGNED_INT, (const void*)0));
+	}
+	else
+	{
+		// The restart index is compared before the base vertex is added
+		CHECKED_GL_CALL(glEnable(GL_PRIMITIVE_RESTART));
+		CHECKED_GL_CALL(glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX));
+		CHECKED_GL_CALL(glMultiDrawElementsBaseVertex(GL_TRIANGLE_STRIP,
+			tileCounts.data(), GL_UNSIGNED_SHORT, tileOffsets.data(),
+			(GLsizei)tileCounts.size(), tileBaseVertices.data()));
+		CHECKED_GL_CALL(glDisable(GL_PRIMITIVE_RESTART));
+	}
 	CHECKED_GL_CALL(glBindVertexArray(0));
+
+	// Mark when the GPU is done reading the current region
+	if (streaming)
+	{
+		GLsync& fence = streamFences[streamRegion];
+		if (fence != 0)
+		{
+			CHECKED_GL_CALL(glDeleteSync(fence));
+		}
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+// Average cache miss ratio, the number of vertex shader invocations per
+// triangle through a FIFO post-transform cache
+// Strips are separated by 0xFFFFFFFF
+float Mesh::computeAcmr(const std::vector<unsigned int>& indices, GLenum mode, int cacheSize)
+{
+	std::deque<unsigned int> cache;
+	size_t misses = 0, triangles = 0, stripLength = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (mode == GL_TRIANGLE_STRIP && indices[i] == 0xFFFFFFFF)
+		{
+			stripLength = 0;
+			continue;
+		}
+
+		if (std::find(cache.begin(), cache.end(), indices[i]) == cache.end())
+		{
+			misses++;
+			cache.push_back(indices[i]);
+			if ((int)cache.size() > cacheSize)
+			{
+				cache.pop_front();
+			}
+		}
+
+		// Every index after the first two of a strip completes a triangle
+		if (mode == GL_TRIANGLE_STRIP && ++stripLength >= 3)
+		{
+			triangles++;
+		}
+	}
+
+	if (mode == GL_TRIANGLES)
+	{
+		triangles = indices.size() / 3;
+	}
+	return triangles > 0 ? (float)misses / triangles : 0.0f;
 }
@@ -9,6 +9,14 @@
 #include <tiny_obj_loader/tiny_obj_loader.h>
 
 #define VERTEX_ATTRIBUTES 8
+#define PRIMITIVE_RESTART_INDEX 0xFFFF
+#define VERTEX_CACHE_SIZE 32		// FIFO entries assumed when measuring ACMR
+
+// Streaming meshes keep this many copies of their positions and normals,
+// so the CPU writes one while the GPU may still read the others
+#define STREAM_REGIONS 3
+#define STREAM_ATTRIBUTES 6
+#define STREAM_WAIT_NS 1000000
 
 
 struct BBox
@@ -17,6 +25,14 @@ struct BBox
 	glm::vec3 max;
 };
 
+// A run of 16-bit strip indices relative to its own base vertex
+struct IndexTile
+{
+	size_t offset;		// First index
+	GLsizei count;
+	GLint baseVertex;
+};
+
 class Mesh
 {
 public:
@@ -24,24 +40,53 @@ public:
 	~Mesh();
 
 	void setDynamic(bool isDynamic);
+	void setStreaming(bool isStreaming);
 	void setupBuffers(std::vector<glm::vec3>& positions, 
 		std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords, 
 		std::vector<unsigned int>& indices);
+	void setupBuffers(std::vector<glm::vec3>& positions,
+		std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords,
+		std::vector<unsigned short>& indices, const std::vector<IndexTile>& tiles);
 	void setupBuffers(const tinyobj::shape_t& shape);
 	void updateBuffers(std::vector<glm::vec3>& positions, 
 		std::vector<glm::vec3>& normals);
+	float* mapVertices();
+	void unmapVertices();
 	void generateBBox(std::vector<glm::vec3>& positions);
 	void generateBBox(std::vector<float>& positions);
 	BBox getBBox() const;
 	void draw() const;
 
+	static float computeAcmr(const std::vector<unsigned int>& indices, GLenum mode,
+		int cacheSize = VERTEX_CACHE_SIZE);
+
 private:
+	void setupVertices(std::vector<glm::vec3>& positions,
+		std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords);
+	void setupStreamingVertices(std::vector<glm::vec3>& positions,
+		std::vector<glm::vec3>& normals, std::vector<glm::vec2>& texCoords);
+	void waitForRegion(int region);
+	void deleteStreamFences();
+
 	std::vector<float> vertBuf;
 	size_t numIndices;
+	size_t numVertices;
+
+	// Tiled triangle strips, drawn in one call when set
+	std::vector<GLsizei> tileCounts;
+	std::vector<const void*> tileOffsets;
+	std::vector<GLint> tileBaseVertices;
 
 	GLuint vaoID, vboID, eboID;
 	GLenum vertUsage; // GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW
 
+	// Ring of vertex regions, with the texture coordinates in their own buffer
+	bool streaming;
+	int streamRegion;
+	GLuint texCoordVboID;
+	mutable GLsync streamFences[STREAM_REGIONS];
+	float* persistentVertices;	// All regions, when mapped persistently
+
 	BBox bbox;
 };
 
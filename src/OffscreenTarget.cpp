@@ -0,0 +1,79 @@
+#include "OffscreenTarget.h"
+
+#include <iostream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+
+OffscreenTarget::OffscreenTarget() :
+	width(0), height(0), fboID(0), colorID(0), depthID(0) {}
+
+OffscreenTarget::~OffscreenTarget() {}
+
+bool OffscreenTarget::init(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	// Renderbuffers, since the frames are only ever read back
+	glGenRenderbuffers(1, &colorID);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &depthID);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthID);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fboID);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete)
+	{
+		std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	pixels.resize((size_t)width * height * 4);
+	return true;
+}
+
+// Makes the target the framebuffer the frame is drawn into and read from
+void OffscreenTarget::bind() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+}
+
+// Reads the last frame back and writes it as a PNG, which waits for the
+// frame to finish drawing
+bool OffscreenTarget::save(const std::string& file)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fboID);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	// GL rows start at the bottom, so write them from the last row up
+	const unsigned char* topRow = pixels.data() + (size_t)(height - 1) * width * 4;
+	if (!stbi_write_png(file.c_str(), width, height, 4, topRow, -width * 4))
+	{
+		std::cerr << "Could not write frame: '" << file << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int OffscreenTarget::getWidth() const
+{
+	return width;
+}
+
+int OffscreenTarget::getHeight() const
+{
+	return height;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+
+// Color and depth framebuffer standing in for the window when rendering
+// without a display, with its frames optionally written out as PNGs
+class OffscreenTarget
+{
+public:
+	OffscreenTarget();
+	~OffscreenTarget();
+
+	bool init(int width, int height);
+	void bind() const;
+	bool save(const std::string& file);
+
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	int width, height;
+	GLuint fboID, colorID, depthID;
+	std::vector<unsigned char> pixels;
+};
+
+#endif // OFFSCREEN_TARGET_H
@@ -0,0 +1,170 @@
+#include "Quadtree.h"
+
+#include <cmath>
+
+// Smallest range of a level in patch sizes, which keeps patches next to
+// each other within one level and the coarser one unmorphed where they meet
+#define MIN_RANGE_PATCHES 8.0f
+
+// Fraction of a level's range where its vertices start to morph
+#define MORPH_START 0.75f
+
+
+#pragma region Frustum
+
+// Extracts the planes from the rows of the matrix
+Frustum::Frustum(const glm::mat4& m)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		planes[2 * i] = rows[3] + rows[i];
+		planes[2 * i + 1] = rows[3] - rows[i];
+	}
+}
+
+// Conservative test, only rejects boxes fully outside one of the planes
+bool Frustum::intersects(const BBox& box) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		// Corner of the box farthest along the plane normal
+		glm::vec3 corner(
+			plane.x > 0.0f ? box.max.x : box.min.x,
+			plane.y > 0.0f ? box.max.y : box.min.y,
+			plane.z > 0.0f ? box.max.z : box.min.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+#pragma endregion
+
+
+#pragma region Quadtree
+
+// Squared distance from a point to the nearest point of a box
+float distanceSquared(const BBox& box, glm::vec3 point)
+{
+	glm::vec3 d = glm::max(box.min - point, glm::max(point - box.max, glm::vec3(0.0f)));
+	return glm::dot(d, d);
+}
+
+Quadtree::Quadtree() : levels(QUADTREE_LEVELS), patchResolution(QUADTREE_PATCH_RES), 
+	spacing(0.1f), vaoID(0) {}
+
+Quadtree::Quadtree(int levels, int patchResolution, float spacing)
+	: levels(levels), patchResolution(patchResolution), spacing(spacing), vaoID(0) {}
+
+Quadtree::~Quadtree() {}
+
+void Quadtree::init()
+{
+	// The patches are generated from gl_VertexID and gl_InstanceID,
+	// but core profiles still need a vertex array bound to draw
+	if (vaoID == 0)
+	{
+		glGenVertexArrays(1, &vaoID);
+	}
+}
+
+// displacementBounds holds the largest horizontal and vertical displacement
+// of the surface, which pad the bounds of every node
+void Quadtree::draw(const Shader& shader, const Camera& camera, glm::vec2 displacementBounds) const
+{
+	glm::vec3 viewer = camera.getPosition();
+	Frustum frustum(camera.getProjectionMatrix() * camera.getViewMatrix());
+
+	// A grid spacing s at distance d projects to s / d * pixelScale pixels,
+	// so each level is drawn out to where its spacing reaches the pixel error
+	float pixelScale = 0.5f * camera.getScreenHeight() * camera.getProjectionMatrix()[1][1];
+	ranges.resize(levels);
+	for (int level = 0; level < levels; level++)
+	{
+		float levelSpacing = spacing * (float)(1 << level);
+		ranges[level] = glm::max(levelSpacing * pixelScale / QUADTREE_PIXEL_ERROR,
+			MIN_RANGE_PATCHES * patchResolution * levelSpacing);
+	}
+
+	// Select the patches, starting from the root centered on the world origin
+	patches.clear();
+	select(frustum, viewer, displacementBounds, 
+		glm::vec2(-0.5f * patchResolution), levels - 1);
+
+	glBindVertexArray(vaoID);
+	shader.setVec3("morphViewer", viewer);
+	shader.setVec2("blockStart", glm::vec2(0.0f));
+
+	for (const Patch& patch : patches)
+	{
+		float levelSpacing = spacing * (float)(1 << patch.level);
+
+		shader.setVec2("levelOrigin", patch.origin);
+		shader.setFloat("levelSpacing", levelSpacing);
+		shader.setVec2("morphRange", glm::vec2(MORPH_START, 1.0f) * ranges[patch.level]);
+
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (patchResolution + 1), patchResolution);
+	}
+
+	glBindVertexArray(0);
+}
+
+// Adds the visible patches of a node, refining it while it is within
+// range of the finer level
+void Quadtree::select(const Frustum& frustum, glm::vec3 viewer, glm::vec2 displacementBounds,
+	glm::vec2 origin, int level) const
+{
+	float levelSpacing = spacing * (float)(1 << level);
+	float size = patchResolution * levelSpacing;
+
+	// Cull the node with the surface displaced as far as it can go
+	glm::vec3 padding(displacementBounds.x, displacementBounds.y, displacementBounds.x);
+	BBox node;
+	node.min = glm::vec3(origin.x, 0.0f, origin.y) * levelSpacing;
+	node.max = node.min + glm::vec3(size, 0.0f, size);
+
+	BBox displaced;
+	displaced.min = node.min - padding;
+	displaced.max = node.max + padding;
+
+	if (!frustum.intersects(displaced))
+		return;
+
+	// Refine by the undisplaced node, like the morph in the vertex shader,
+	// so the vertices of a patch are always at least this far away
+	float range = level > 0 ? ranges[level - 1] : 0.0f;
+	if (level == 0 || distanceSquared(node, viewer) > range * range)
+	{
+		patches.push_back({ origin, level });
+		return;
+	}
+
+	// Children have half the spacing, so the origin doubles in their cells
+	glm::vec2 childOrigin = 2.0f * origin;
+	float half = (float)patchResolution;
+	select(frustum, viewer, displacementBounds, childOrigin, level - 1);
+	select(frustum, viewer, displacementBounds, childOrigin + glm::vec2(half, 0.0f), level - 1);
+	select(frustum, viewer, displacementBounds, childOrigin + glm::vec2(0.0f, half), level - 1);
+	select(frustum, viewer, displacementBounds, childOrigin + glm::vec2(half), level - 1);
+}
+
+size_t Quadtree::getPatchCount() const
+{
+	return patches.size();
+}
+
+// Distance from the center to the edge of the root
+float Quadtree::getExtent() const
+{
+	return 0.5f * patchResolution * spacing * (float)(1 << (levels - 1));
+}
+
+#pragma endregion
@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef QUADTREE_H
+#define QUADTREE_H
+
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+#include "Camera.h"
+
+#define QUADTREE_LEVELS 10
+#define QUADTREE_PATCH_RES 32		// Quads per side of each patch, even
+#define QUADTREE_PIXEL_ERROR 2.0f	// Largest projected grid spacing in pixels
+
+
+// View frustum planes, with normals pointing inwards
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum(const glm::mat4& viewProjection);
+
+	bool intersects(const BBox& box) const;
+};
+
+// Continuous distance-dependent LOD over a quadtree of square patches
+// Each frame, the visible nodes are refined until their grid spacing projects
+// to less than the pixel error, and every patch is the same grid generated in
+// the vertex shader at its node's spacing.
+// Vertices slide onto the coarser grid before the end of each level's range,
+// so neighboring patches one level apart meet without cracks or popping
+class Quadtree
+{
+public:
+	Quadtree();
+	Quadtree(int levels, int patchResolution, float spacing);
+	~Quadtree();
+
+	void init();
+	void draw(const Shader& shader, const Camera& camera, glm::vec2 displacementBounds) const;
+
+	size_t getPatchCount() const;
+	float getExtent() const;
+
+private:
+	struct Patch
+	{
+		glm::vec2 origin;	// First vertex in cells of the patch's spacing
+		int level;			// Zero is the finest
+	};
+
+	void select(const Frustum& frustum, glm::vec3 viewer, glm::vec2 displacementBounds,
+		glm::vec2 origin, int level) const;
+
+	int levels;
+	int patchResolution;
+	float spacing;		// Grid spacing of the finest level
+
+	// Rebuilt every frame
+	mutable std::vector<float> ranges;		// Distance each level is drawn out to
+	mutable std::vector<Patch> patches;
+
+	GLuint vaoID;
+};
+
+#endif // QUADTREE_H
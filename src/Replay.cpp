@@ -0,0 +1,201 @@
+#include "Replay.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+// Marks the start of a replay log
+static const char replayMagic[4] = { 'O', 'S', 'R', 'P' };
+
+// Optional fields of a frame
+#define FRAME_ROTATION 0x1
+#define FRAME_WAVE_FUNCTION 0x2
+#define FRAME_WEATHER 0x4
+
+template <typename T>
+void writeValue(std::ofstream& output, const T& value)
+{
+	output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& input, T& value)
+{
+	return (bool)input.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+Replay::Replay() : waveFunction(-1), weather(0) {}
+
+Replay::~Replay()
+{
+	stop();
+}
+
+bool Replay::startRecording(const std::string& path, const ReplaySettings& settings)
+{
+	stop();
+
+	output.open(path, std::ios::binary);
+	if (!output)
+	{
+		std::cerr << "Could not open replay for writing: '" << path << "'" << std::endl;
+		return false;
+	}
+
+	this->settings = settings;
+	waveFunction = settings.waveFunction;
+	weather = 0;
+
+	output.write(replayMagic, sizeof(replayMagic));
+	writeValue(output, (uint32_t)REPLAY_VERSION);
+	writeValue(output, settings);
+	return true;
+}
+
+void Replay::recordFrame(const ReplayFrame& frame)
+{
+	if (!output.is_open())
+		return;
+
+	uint8_t flags = 0;
+	if (frame.rotation != glm::vec2(0.0f))
+	{
+		flags |= FRAME_ROTATION;
+	}
+	if (frame.waveFunction != waveFunction)
+	{
+		flags |= FRAME_WAVE_FUNCTION;
+	}
+	if (frame.weather != weather)
+	{
+		flags |= FRAME_WEATHER;
+	}
+
+	// The frame time is kept in full, so the fixed steps it is split into
+	// come out the same on playback
+	writeValue(output, flags);
+	writeValue(output, frame.deltaTime);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		writeValue(output, (int8_t)frame.moveDirection[axis]);
+	}
+
+	if (flags & FRAME_ROTATION)
+	{
+		writeValue(output, frame.rotation);
+	}
+	if (flags & FRAME_WAVE_FUNCTION)
+	{
+		writeValue(output, (uint8_t)frame.waveFunction);
+		waveFunction = frame.waveFunction;
+	}
+	if (flags & FRAME_WEATHER)
+	{
+		writeValue(output, (int32_t)frame.weather);
+		weather = frame.weather;
+	}
+}
+
+bool Replay::startPlayback(const std::string& path)
+{
+	stop();
+
+	input.open(path, std::ios::binary);
+	if (!input)
+	{
+		std::cerr << "Could not open replay: '" << path << "'" << std::endl;
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	input.read(magic, sizeof(magic));
+	readValue(input, version);
+	if (!input || memcmp(magic, replayMagic, sizeof(magic)) != 0 || version != REPLAY_VERSION)
+	{
+		std::cerr << "Not a version " << REPLAY_VERSION << " replay: '" << path << "'" << std::endl;
+		input.close();
+		return false;
+	}
+
+	if (!readValue(input, settings))
+	{
+		std::cerr << "Replay is truncated: '" << path << "'" << std::endl;
+		input.close();
+		return false;
+	}
+
+	waveFunction = settings.waveFunction;
+	weather = 0;
+	return true;
+}
+
+// Returns false once the log runs out
+bool Replay::readFrame(ReplayFrame& frame)
+{
+	if (!input.is_open())
+		return false;
+
+	uint8_t flags;
+	int8_t move[3];
+	if (!readValue(input, flags) || !readValue(input, frame.deltaTime) || !readValue(input, move))
+	{
+		input.close();
+		return false;
+	}
+	frame.moveDirection = glm::vec3(move[0], move[1], move[2]);
+
+	frame.rotation = glm::vec2(0.0f);
+	if (flags & FRAME_ROTATION)
+	{
+		readValue(input, frame.rotation);
+	}
+	if (flags & FRAME_WAVE_FUNCTION)
+	{
+		uint8_t value = 0;
+		readValue(input, value);
+		waveFunction = value;
+	}
+	if (flags & FRAME_WEATHER)
+	{
+		int32_t value = 0;
+		readValue(input, value);
+		weather = value;
+	}
+	frame.waveFunction = waveFunction;
+	frame.weather = weather;
+
+	if (!input)
+	{
+		input.close();
+		return false;
+	}
+	return true;
+}
+
+void Replay::stop()
+{
+	if (output.is_open())
+	{
+		output.close();
+	}
+	if (input.is_open())
+	{
+		input.close();
+	}
+}
+
+bool Replay::isRecording() const
+{
+	return output.is_open();
+}
+
+bool Replay::isPlaying() const
+{
+	return input.is_open();
+}
+
+const ReplaySettings& Replay::getSettings() const
+{
+	return settings;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <string>
+#include <fstream>
+#include <glm/glm.hpp>
+
+// Bumped whenever the layout of the log changes
+#define REPLAY_VERSION 2
+
+
+// Everything the simulation is set up from
+struct ReplaySettings
+{
+	unsigned int waveSeed;
+	float medianWavelength;
+	float medianAmplitude;
+	float spreadAngle;
+	int waveCount;
+	int waveFunction;
+};
+
+// Inputs of one frame, in the order the frame applies them
+struct ReplayFrame
+{
+	double deltaTime;
+	glm::vec3 moveDirection;	// Each axis is -1, 0 or 1
+	glm::vec2 rotation;			// Camera rotation offsets since the last frame
+	int waveFunction;
+	int weather;				// Counts the wave sets faded in so far
+};
+
+// Records the inputs of a run to a compact binary log and plays them back,
+// so the simulation can be rerun step for step
+// Each frame is a flags byte, the frame time, the move direction as bytes,
+// and the rotation, wave function and weather only when they are present
+// The log is written in the byte order of the machine that records it
+class Replay
+{
+public:
+	Replay();
+	~Replay();
+
+	bool startRecording(const std::string& path, const ReplaySettings& settings);
+	void recordFrame(const ReplayFrame& frame);
+
+	bool startPlayback(const std::string& path);
+	bool readFrame(ReplayFrame& frame);
+
+	void stop();
+	bool isRecording() const;
+	bool isPlaying() const;
+	const ReplaySettings& getSettings() const;
+
+private:
+	std::ofstream output;
+	std::ifstream input;
+	ReplaySettings settings;
+
+	// Wave function and weather of the last frame, only logged when they
+	// change
+	int waveFunction;
+	int weather;
+};
+
+#endif // REPLAY_H
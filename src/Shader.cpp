@@ -2,8 +2,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include "GLSL.h"
 
+// Guards against include cycles
+#define MAX_INCLUDE_DEPTH 8
+
 std::string readFileAsString(const std::string& filepath)
 {
 	std::string result;
@@ -27,57 +31,111 @@ std::string readFileAsString(const std::string& filepath)
 	return result;
 }
 
+// Replaces each #include "file" line with the file's source,
+// resolved relative to the directory of the including file
+std::string resolveIncludes(const std::string& source, 
+	const std::string& filepath, int depth = 0)
+{
+	if (depth > MAX_INCLUDE_DEPTH)
+	{
+		std::cerr << "Shader includes nested too deeply in: '" << filepath 
+			<< "'" << std::endl;
+		return source;
+	}
+
+	size_t slash = filepath.find_last_of("/\\");
+	std::string directory = (slash == std::string::npos) ? 
+		"" : filepath.substr(0, slash + 1);
+
+	std::istringstream lines(source);
+	std::string result, line;
+	while (std::getline(lines, line))
+	{
+		size_t directive = line.find("#include");
+		size_t open = line.find('"', directive);
+		size_t close = (open == std::string::npos) ? 
+			std::string::npos : line.find('"', open + 1);
+
+		if (directive == std::string::npos || close == std::string::npos ||
+			line.find_first_not_of(" \t") != directive)
+		{
+			result += line + "\n";
+			continue;
+		}
+
+		std::string includePath = directory + line.substr(open + 1, close - open - 1);
+		result += resolveIncludes(readFileAsString(includePath), includePath, depth + 1);
+	}
+
+	return result;
+}
+
 bool Shader::init(const std::string& vShaderFilepath, 
 	const std::string& fShaderFilepath)
+{
+	return init(vShaderFilepath, "", "", fShaderFilepath);
+}
+
+// Tessellation stages are skipped when their paths are empty
+bool Shader::init(const std::string& vShaderFilepath,
+	const std::string& tcShaderFilepath, const std::string& teShaderFilepath,
+	const std::string& fShaderFilepath)
 {
 	vShaderName = vShaderFilepath;
+	tcShaderName = tcShaderFilepath;
+	teShaderName = teShaderFilepath;
 	fShaderName = fShaderFilepath;
 
-	// Retrieve shader source code from the file
-	std::string vertexCode = readFileAsString(vShaderFilepath);
-	std::string fragmentCode = readFileAsString(fShaderFilepath);
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
-
-	GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
+	struct Stage
+	{
+		GLenum type;
+		const std::string& filepath;
+		const char* name;
+	};
+	const Stage stages[] = {
+		{ GL_VERTEX_SHADER, vShaderName, "vertex" },
+		{ GL_TESS_CONTROL_SHADER, tcShaderName, "tessellation control" },
+		{ GL_TESS_EVALUATION_SHADER, teShaderName, "tessellation evaluation" },
+		{ GL_FRAGMENT_SHADER, fShaderName, "fragment" },
+	};
 
-	CHECKED_GL_CALL(glShaderSource(vShader, 1, &vShaderCode, NULL));
-	CHECKED_GL_CALL(glShaderSource(fShader, 1, &fShaderCode, NULL));
+	pid = glCreateProgram();
 
-	// Compile vertex shader
-	GLint rc;
-	CHECKED_GL_CALL(glCompileShader(vShader));
-	CHECKED_GL_CALL(glGetShaderiv(vShader, GL_COMPILE_STATUS, &rc));
-	if (!rc)
+	for (const Stage& stage : stages)
 	{
-		if (verbose)
+		if (stage.filepath.empty())
 		{
-			GLSL::printShaderInfoLog(vShader);
-			std::cout << "Error compiling vertex shader " 
-				<< vShaderName << std::endl;
+			continue;
 		}
-		return false;
-	}
 
-	// Compile fragment shader
-	CHECKED_GL_CALL(glCompileShader(fShader));
-	CHECKED_GL_CALL(glGetShaderiv(fShader, GL_COMPILE_STATUS, &rc));
-	if (!rc)
-	{
-		if (verbose)
+		// Retrieve shader source code from the file
+		std::string code = resolveIncludes(
+			readFileAsString(stage.filepath), stage.filepath);
+		const char* shaderCode = code.c_str();
+
+		GLuint shader = glCreateShader(stage.type);
+		CHECKED_GL_CALL(glShaderSource(shader, 1, &shaderCode, NULL));
+
+		// Compile the stage
+		GLint rc;
+		CHECKED_GL_CALL(glCompileShader(shader));
+		CHECKED_GL_CALL(glGetShaderiv(shader, GL_COMPILE_STATUS, &rc));
+		if (!rc)
 		{
-			GLSL::printShaderInfoLog(fShader);
-			std::cout << "Error compiling fragment shader " 
-				<< fShaderName << std::endl;
+			if (verbose)
+			{
+				GLSL::printShaderInfoLog(shader);
+				std::cout << "Error compiling " << stage.name << " shader "
+					<< stage.filepath << std::endl;
+			}
+			return false;
 		}
-		return false;
+
+		CHECKED_GL_CALL(glAttachShader(pid, shader));
 	}
 
-	// Create the program and link
-	pid = glCreateProgram();
-	CHECKED_GL_CALL(glAttachShader(pid, vShader));
-	CHECKED_GL_CALL(glAttachShader(pid, fShader));
+	// Link the program
+	GLint rc;
 	CHECKED_GL_CALL(glLinkProgram(pid));
 	CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
 	if (!rc)
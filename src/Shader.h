@@ -14,6 +14,8 @@ public:
 	bool isVerbose() const { return verbose; }
 
 	bool init(const std::string& vShaderFile, const std::string& fShaderFile);
+	bool init(const std::string& vShaderFile, const std::string& tcShaderFile,
+		const std::string& teShaderFile, const std::string& fShaderFile);
 	void bind();
 	void unbind();
 
@@ -30,6 +32,8 @@ public:
 	void setMat4(const std::string& name, const glm::mat4& value) const;
 
 	std::string vShaderName;
+	std::string tcShaderName;
+	std::string teShaderName;
 	std::string fShaderName;
 
 private:
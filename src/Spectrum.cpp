@@ -0,0 +1,375 @@
+#include "Spectrum.h"
+
+#include <cmath>
+#include <random>
+#include <glm/gtc/type_ptr.hpp>
+#include "ThreadPool.h"
+
+#define GRAVITY 9.81f
+
+// Fetch used by the JONSWAP spectrum, in meters
+#define JONSWAP_FETCH 100000.0f
+
+typedef std::complex<float> Complex;
+
+// Multiplies without the NaN checks std::complex performs
+inline Complex mul(Complex a, Complex b)
+{
+	return Complex(a.real() * b.real() - a.imag() * b.imag(),
+		a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Multiplies by i
+inline Complex mulI(Complex a)
+{
+	return Complex(-a.imag(), a.real());
+}
+
+
+Spectrum::Spectrum() : choppiness(1.0f), resolution(0), length(0.0f), windSpeed(0.0f),
+	windDirection(glm::vec2(1.0f, 0.0f)), type(PHILLIPS),
+	displacementTexID(0), normalTexID(0) {}
+
+Spectrum::~Spectrum() {}
+
+// resolution must be a power of two
+void Spectrum::generate(unsigned int seed, int resolution, float length,
+	float windSpeed, glm::vec2 windDirection, SpectrumType type)
+{
+	this->resolution = resolution;
+	this->length = length;
+	this->windSpeed = windSpeed;
+	this->windDirection = glm::normalize(windDirection);
+	this->type = type;
+
+	int n = resolution;
+	size_t size = (size_t)n * n;
+
+	// Precompute the twiddle factors e^(2 pi i k / n) of the inverse transform
+	twiddles.resize(n / 2);
+	for (int k = 0; k < n / 2; k++)
+	{
+		float angle = glm::two_pi<float>() * k / n;
+		twiddles[k] = Complex(cos(angle), sin(angle));
+	}
+
+	// Precompute the bit reversal permutation
+	int bits = 0;
+	while ((1 << bits) < n) bits++;
+
+	bitReverse.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+		{
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		bitReverse[i] = r;
+	}
+
+	// Draw the initial amplitudes from the spectrum
+	std::mt19937 generator(seed);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+	float dk = glm::two_pi<float>() / length;
+	std::vector<Complex> amplitudes(size);
+	omega.resize(size);
+
+	for (int z = 0; z < n; z++)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			// FFT ordering, the upper half of the indices holds negative frequencies
+			glm::vec2 k((x < n / 2 ? x : x - n) * dk, (z < n / 2 ? z : z - n) * dk);
+			float energy = type == JONSWAP ? jonswap(k) : phillips(k);
+
+			// Drop the Nyquist frequencies, which have no conjugate partner
+			if (x == n / 2 || z == n / 2)
+				energy = 0.0f;
+
+			// Each mode shows up at k and -k, so E[|h0|^2] = spectrum * dk^2 / 2
+			float amplitude = sqrt(energy * dk * dk * 0.25f);
+			amplitudes[z * n + x] = Complex(gaussian(generator), gaussian(generator)) * amplitude;
+			omega[z * n + x] = sqrt(GRAVITY * glm::length(k));
+		}
+	}
+
+	h0.resize(size);
+	h0MinusConj.resize(size);
+	for (int z = 0; z < n; z++)
+	{
+		for (int x = 0; x < n; x++)
+		{
+			int minus = ((n - z) % n) * n + (n - x) % n;
+			h0[z * n + x] = amplitudes[z * n + x];
+			h0MinusConj[z * n + x] = std::conj(amplitudes[minus]);
+		}
+	}
+
+	heightDx.resize(size);
+	dzSlopeX.resize(size);
+	slopeZ.resize(size);
+	displacementMap.resize(size, glm::vec4(0.0f));
+	normalMap.resize(size, glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+
+	update(0.0);
+}
+
+// Directional variance density of the Phillips spectrum
+float Spectrum::phillips(glm::vec2 k) const
+{
+	float k2 = glm::dot(k, k);
+	if (k2 < 1e-12f)
+		return 0.0f;
+
+	// Largest wave produced by the wind, and a cutoff for tiny waves
+	float largest = windSpeed * windSpeed / GRAVITY;
+	float smallest = largest * 0.001f;
+
+	// Spread over the full circle with a normalized cos^2 distribution
+	float cosTheta = glm::dot(k / sqrt(k2), windDirection);
+	float spreading = cosTheta * cosTheta / glm::pi<float>();
+
+	return 0.0081f / glm::two_pi<float>() / (k2 * k2) * spreading
+		* exp(-1.0f / (k2 * largest * largest)) * exp(-k2 * smallest * smallest);
+}
+
+// Directional variance density of the JONSWAP spectrum for a fetch-limited sea
+float Spectrum::jonswap(glm::vec2 k) const
+{
+	float kLen = glm::length(k);
+	if (kLen < 1e-6f)
+		return 0.0f;
+
+	// Spreading over the half circle facing the wind
+	float cosTheta = glm::dot(k / kLen, windDirection);
+	if (cosTheta <= 0.0f)
+		return 0.0f;
+	float spreading = 2.0f / glm::pi<float>() * cosTheta * cosTheta;
+
+	// Deep water dispersion w = sqrt(gk)
+	float w = sqrt(GRAVITY * kLen);
+	float alpha = 0.076f * pow(windSpeed * windSpeed / (JONSWAP_FETCH * GRAVITY), 0.22f);
+	float peak = 22.0f * pow(GRAVITY * GRAVITY / (windSpeed * JONSWAP_FETCH), 1.0f / 3.0f);
+
+	float sigma = w <= peak ? 0.07f : 0.09f;
+	float r = exp(-(w - peak) * (w - peak) / (2.0f * sigma * sigma * peak * peak));
+	float s = alpha * GRAVITY * GRAVITY / pow(w, 5.0f)
+		* exp(-1.25f * pow(peak / w, 4.0f)) * pow(3.3f, r);
+
+	// Convert S(w) to the wavenumber domain, dw/dk = g / 2w
+	return s * GRAVITY / (2.0f * w) / kLen * spreading;
+}
+
+// In-place inverse FFT of one row, without normalization
+void Spectrum::fft(Complex* data) const
+{
+	int n = resolution;
+
+	for (int i = 0; i < n; i++)
+	{
+		int j = bitReverse[i];
+		if (i < j) std::swap(data[i], data[j]);
+	}
+
+	for (int size = 2; size <= n; size *= 2)
+	{
+		int half = size / 2;
+		int step = n / size;
+		for (int start = 0; start < n; start += size)
+		{
+			for (int k = 0; k < half; k++)
+			{
+				Complex t = mul(twiddles[k * step], data[start + k + half]);
+				data[start + k + half] = data[start + k] - t;
+				data[start + k] += t;
+			}
+		}
+	}
+}
+
+// Transforms the rows and then the columns of all fields across the thread pool
+void Spectrum::fft2D()
+{
+	int n = resolution;
+	Complex* fields[3] = { heightDx.data(), dzSlopeX.data(), slopeZ.data() };
+	ThreadPool* pool = ThreadPool::getInstance();
+
+	pool->parallelFor(3 * n, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			fft(fields[i / n] + (i % n) * n);
+		}
+	});
+
+	pool->parallelFor(3 * n, [&](size_t begin, size_t end) {
+		std::vector<Complex> column(n);
+		for (size_t i = begin; i < end; i++)
+		{
+			Complex* field = fields[i / n];
+			int x = (int)(i % n);
+
+			for (int z = 0; z < n; z++) column[z] = field[z * n + x];
+			fft(column.data());
+			for (int z = 0; z < n; z++) field[z * n + x] = column[z];
+		}
+	});
+}
+
+void Spectrum::update(double time)
+{
+	int n = resolution;
+	float dk = glm::two_pi<float>() / length;
+	ThreadPool* pool = ThreadPool::getInstance();
+
+	// Evolve the amplitudes to the current time and build the packed fields
+	pool->parallelFor(n, [&](size_t begin, size_t end) {
+		for (size_t z = begin; z < end; z++)
+		{
+			float kz = ((int)z < n / 2 ? (int)z : (int)z - n) * dk;
+			for (int x = 0; x < n; x++)
+			{
+				float kx = (x < n / 2 ? x : x - n) * dk;
+				size_t i = z * n + x;
+
+				// h(k, t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+				float phase = (float)fmod(omega[i] * time, glm::two_pi<double>());
+				Complex e(cos(phase), sin(phase));
+				Complex h = mul(h0[i], e) + mul(h0MinusConj[i], std::conj(e));
+
+				// Choppy displacement i * k / |k| * h and slopes i * k * h
+				float kLen = sqrt(kx * kx + kz * kz);
+				float invLen = kLen > 1e-6f ? 1.0f / kLen : 0.0f;
+				Complex ih = mulI(h);
+
+				heightDx[i] = h + mulI(ih * (kx * invLen));
+				dzSlopeX[i] = ih * (kz * invLen) + mulI(ih * kx);
+				slopeZ[i] = ih * kz;
+			}
+		}
+	});
+
+	fft2D();
+
+	// Unpack the real fields into the maps
+	pool->parallelFor(n, [&](size_t begin, size_t end) {
+		for (size_t i = begin * n; i < end * n; i++)
+		{
+			float h = heightDx[i].real();
+			float dx = heightDx[i].imag() * choppiness;
+			float dz = dzSlopeX[i].real() * choppiness;
+			float sx = dzSlopeX[i].imag();
+			float sz = slopeZ[i].real();
+
+			displacementMap[i] = glm::vec4(dx, h, dz, 0.0f);
+			normalMap[i] = glm::vec4(glm::normalize(glm::vec3(-sx, 1.0f, -sz)), 0.0f);
+		}
+	});
+}
+
+bool Spectrum::isGenerated() const
+{
+	return resolution > 0;
+}
+
+int Spectrum::getResolution() const
+{
+	return resolution;
+}
+
+float Spectrum::getLength() const
+{
+	return length;
+}
+
+const std::vector<glm::vec4>& Spectrum::getDisplacementMap() const
+{
+	return displacementMap;
+}
+
+const std::vector<glm::vec4>& Spectrum::getNormalMap() const
+{
+	return normalMap;
+}
+
+// Bilinearly samples a map at a world-space point, wrapping around the tile
+glm::vec4 Spectrum::sample(const std::vector<glm::vec4>& map, float x, float z) const
+{
+	int n = resolution;
+	float u = x / length * n;
+	float v = z / length * n;
+	float u0 = floor(u);
+	float v0 = floor(v);
+	float tu = u - u0;
+	float tv = v - v0;
+
+	int x0 = (int)u0 & (n - 1);
+	int z0 = (int)v0 & (n - 1);
+	int x1 = (x0 + 1) & (n - 1);
+	int z1 = (z0 + 1) & (n - 1);
+
+	glm::vec4 a = map[z0 * n + x0] * (1.0f - tu) + map[z0 * n + x1] * tu;
+	glm::vec4 b = map[z1 * n + x0] * (1.0f - tu) + map[z1 * n + x1] * tu;
+	return a * (1.0f - tv) + b * tv;
+}
+
+void Spectrum::getDisplacements(const float* xs, const float* zs, size_t count,
+	float* heights, float* dxs, float* dzs) const
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec4 d = sample(displacementMap, xs[i], zs[i]);
+		heights[i] = d.y;
+		if (dxs) dxs[i] = d.x;
+		if (dzs) dzs[i] = d.z;
+	}
+}
+
+glm::vec3 Spectrum::sampleNormal(float x, float z) const
+{
+	return glm::normalize(glm::vec3(sample(normalMap, x, z)));
+}
+
+void Spectrum::setupTextures()
+{
+	GLuint* ids[2] = { &displacementTexID, &normalTexID };
+	for (GLuint* id : ids)
+	{
+		glGenTextures(1, id);
+		glBindTexture(GL_TEXTURE_2D, *id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution, resolution, 0,
+			GL_RGBA, GL_FLOAT, nullptr);
+
+		// The maps tile across the water plane
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	updateTextures();
+}
+
+void Spectrum::updateTextures()
+{
+	glBindTexture(GL_TEXTURE_2D, displacementTexID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution,
+		GL_RGBA, GL_FLOAT, displacementMap.data());
+
+	glBindTexture(GL_TEXTURE_2D, normalTexID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution, resolution,
+		GL_RGBA, GL_FLOAT, normalMap.data());
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Spectrum::bindTextures(GLint displacementUnit, GLint normalUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + displacementUnit);
+	glBindTexture(GL_TEXTURE_2D, displacementTexID);
+	glActiveTexture(GL_TEXTURE0 + normalUnit);
+	glBindTexture(GL_TEXTURE_2D, normalTexID);
+	glActiveTexture(GL_TEXTURE0);
+}
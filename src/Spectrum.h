@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <vector>
+#include <complex>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+
+enum SpectrumType
+{
+	PHILLIPS,
+	JONSWAP,
+};
+
+// Tessendorf-style spectral ocean
+// An N x N grid of frequency-domain amplitudes is evolved each frame and
+// transformed with a radix-2 FFT into periodic displacement and normal maps
+// that tile every `length` meters
+class Spectrum
+{
+public:
+	Spectrum();
+	~Spectrum();
+
+	void generate(unsigned int seed, int resolution, float length,
+		float windSpeed, glm::vec2 windDirection, SpectrumType type);
+	void update(double time);
+
+	bool isGenerated() const;
+	int getResolution() const;
+	float getLength() const;
+	const std::vector<glm::vec4>& getDisplacementMap() const;
+	const std::vector<glm::vec4>& getNormalMap() const;
+
+	void getDisplacements(const float* xs, const float* zs, size_t count,
+		float* heights, float* dxs = nullptr, float* dzs = nullptr) const;
+	glm::vec3 sampleNormal(float x, float z) const;
+
+	void setupTextures();
+	void updateTextures();
+	void bindTextures(GLint displacementUnit, GLint normalUnit) const;
+
+	float choppiness;
+
+private:
+	float phillips(glm::vec2 k) const;
+	float jonswap(glm::vec2 k) const;
+	void fft(std::complex<float>* data) const;
+	void fft2D();
+	glm::vec4 sample(const std::vector<glm::vec4>& map, float x, float z) const;
+
+	int resolution;
+	float length;
+	float windSpeed;
+	glm::vec2 windDirection;
+	SpectrumType type;
+
+	// Initial amplitudes h0(k) and conj(h0(-k)), and dispersion w(k)
+	std::vector<std::complex<float>> h0;
+	std::vector<std::complex<float>> h0MinusConj;
+	std::vector<float> omega;
+
+	// FFT tables
+	std::vector<std::complex<float>> twiddles;
+	std::vector<int> bitReverse;
+
+	// Pairs of real fields packed into complex FFTs
+	std::vector<std::complex<float>> heightDx;		// h + i * dx
+	std::vector<std::complex<float>> dzSlopeX;		// dz + i * dh/dx
+	std::vector<std::complex<float>> slopeZ;		// dh/dz
+
+	std::vector<glm::vec4> displacementMap;		// {dx, h, dz, 0}
+	std::vector<glm::vec4> normalMap;			// {Nx, Ny, Nz, 0}
+
+	GLuint displacementTexID, normalTexID;
+};
+
+#endif // SPECTRUM_H
@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+
+ThreadPool* ThreadPool::getInstance()
+{
+	static ThreadPool instance;
+	return &instance;
+}
+
+ThreadPool::ThreadPool() : task(nullptr), count(0), generation(0), pending(0), 
+	stopping(false)
+{
+	startWorkers((int)std::thread::hardware_concurrency());
+}
+
+ThreadPool::~ThreadPool()
+{
+	stopWorkers();
+}
+
+int ThreadPool::getThreadCount() const
+{
+	return (int)workers.size() + 1;
+}
+
+void ThreadPool::setThreadCount(int threads)
+{
+	std::lock_guard<std::mutex> callLock(callMutex);
+	stopWorkers();
+	startWorkers(threads);
+}
+
+// The calling thread takes part, so start one worker fewer than threads
+// Workers only run tasks published after they start
+void ThreadPool::startWorkers(int threads)
+{
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this, i, generation);
+	}
+}
+
+void ThreadPool::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startCondition.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t)>& task)
+{
+	// Not worth waking the workers
+	if (workers.empty() || count < 2)
+	{
+		task(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> callLock(callMutex);
+
+	// Publish the task and wake the workers
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		pending = (int)workers.size();
+		generation++;
+	}
+	startCondition.notify_all();
+
+	runRange(0);
+
+	// Wait for the workers to finish their ranges
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return pending == 0; });
+	this->task = nullptr;
+}
+
+void ThreadPool::workerLoop(int index, unsigned int seenGeneration)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startCondition.wait(lock, [&] { 
+				return stopping || generation != seenGeneration; 
+			});
+
+			if (stopping)
+				return;
+			seenGeneration = generation;
+		}
+
+		runRange(index);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending == 0)
+			doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runRange(int index)
+{
+	size_t threads = workers.size() + 1;
+	size_t begin = count * index / threads;
+	size_t end = count * (index + 1) / threads;
+
+	if (begin < end)
+		(*task)(begin, end);
+}
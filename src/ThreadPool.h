@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+class ThreadPool
+{
+public:
+	// This class implements the singleton design pattern
+	static ThreadPool* getInstance();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator= (const ThreadPool&) = delete;
+
+	int getThreadCount() const;
+
+	// Restarts the pool with the given number of threads, counting the
+	// calling thread, for measuring how the work scales
+	void setThreadCount(int threads);
+
+	// Splits [0, count) into one contiguous range per thread and blocks until
+	// all ranges are done. The calling thread works on the first range.
+	// Tasks must not call parallelFor themselves.
+	void parallelFor(size_t count, const std::function<void(size_t, size_t)>& task);
+
+private:
+	// This class implements the singleton design pattern
+	ThreadPool();
+	~ThreadPool();
+
+	void startWorkers(int threads);
+	void stopWorkers();
+	void workerLoop(int index, unsigned int seenGeneration);
+	void runRange(int index);
+
+	std::vector<std::thread> workers;
+	std::mutex callMutex;
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+
+	const std::function<void(size_t, size_t)>* task;
+	size_t count;
+	unsigned int generation;
+	int pending;
+	bool stopping;
+};
+
+#endif // THREAD_POOL_H
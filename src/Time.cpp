@@ -1,28 +1,66 @@
 #include "Time.h"
 
+#include <algorithm>
+
 Time* Time::getInstance()
 {
 	static Time instance;
 	return &instance;
 }
 
-Time::Time() : time(glfwGetTime()), deltaTime(0.0f) {}
+Time::Time() : time(glfwGetTime()), deltaTime(0.0), accumulator(0.0), simulationTime(0.0) {}
 
 Time::~Time() {}
 
+// Time is kept in double precision, since a float clock loses milliseconds
+// after a few hours
 void Time::updateTime()
 {
-	double lastTime = time;
-	time = glfwGetTime();
-	deltaTime = time - lastTime;
+	updateTime(glfwGetTime() - time);
+}
+
+// Advances the clock by a given frame time instead of reading it, for
+// playing back recorded runs
+void Time::updateTime(double deltaTime)
+{
+	time += deltaTime;
+	this->deltaTime = deltaTime;
+
+	// Drop the time past the step limit, so a slow frame slows the
+	// simulation down instead of making the next frame slower
+	accumulator = std::min(accumulator + deltaTime, MAX_SIMULATION_STEPS * SIMULATION_STEP);
 }
 
-float Time::getTime() const
+double Time::getTime() const
 {
 	return time;
 }
 
-float Time::getDeltaTime() const
+double Time::getDeltaTime() const
 {
 	return deltaTime;
 }
+
+// Consumes one fixed step of the frame time, returning false once the
+// simulation has caught up
+bool Time::stepSimulation()
+{
+	if (accumulator < SIMULATION_STEP)
+		return false;
+
+	accumulator -= SIMULATION_STEP;
+	simulationTime += SIMULATION_STEP;
+	return true;
+}
+
+double Time::getSimulationTime() const
+{
+	return simulationTime;
+}
+
+// Fraction of a step the frame is past the last step, for blending between
+// the last two simulated states
+float Time::getInterpolation() const
+{
+	return (float)(accumulator / SIMULATION_STEP);
+}
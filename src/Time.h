@@ -6,6 +6,11 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+// Length of a simulation step in seconds, and the most steps taken in one
+// frame before the simulation gives up on catching up with real time
+#define SIMULATION_STEP (1.0 / 60.0)
+#define MAX_SIMULATION_STEPS 4
+
 class Time
 {
 public:
@@ -15,16 +20,25 @@ public:
 	Time& operator= (const Time&) = delete;
 
 	void updateTime();
-	float getTime() const;
-	float getDeltaTime() const;
+	void updateTime(double deltaTime);
+	double getTime() const;
+	double getDeltaTime() const;
+
+	bool stepSimulation();
+	double getSimulationTime() const;
+	float getInterpolation() const;
 
 private:
 	// This class implements the singleton design pattern
 	Time();
 	~Time();
 
-	float time;
-	float deltaTime;
+	double time;
+	double deltaTime;
+
+	// Real time not yet simulated, and the time of the last step
+	double accumulator;
+	double simulationTime;
 };
 
 #endif // TIME_H
@@ -1,8 +1,18 @@
 #include "Water.h"
 
+#include <cmath>
 #include <random>
+#include <algorithm>
+#include <iostream>
+#include "WaveKernels.h"
+#include "ThreadPool.h"
+#include "GLSL.h"
 #include <glm/gtc/type_ptr.hpp>
 
+// Number of points inverted together, small enough for the scratch
+// displacement arrays to stay on the stack
+#define SURFACE_CHUNK 256
+
 
 #pragma region Wave
 
@@ -36,26 +46,254 @@ Wave flatWave()
 #pragma endregion
 
 
+#pragma region WaveFrame
+
+WaveFrame::WaveFrame() : count(0), waves() {}
+
+WaveFrame::WaveFrame(const std::vector<Wave>& waves, double time)
+	: count(0), waves()
+{
+	fold(waves, time);
+}
+
+// Padding slots are left as flat waves, so kernels can round the count up
+// The storage is reused between frames
+void WaveFrame::fold(const std::vector<Wave>& waves, double time)
+{
+	count = (int)waves.size();
+	this->waves.assign((count + WAVE_BLOCK - 1) / WAVE_BLOCK * WAVE_BLOCK, WaveConstants());
+
+	for (int i = 0; i < count; i++)
+	{
+		const Wave& w = waves[i];
+		WaveConstants& c = this->waves[i];
+
+		// Fold the direction into the frequency and the Gerstner offsets
+		glm::vec2 d = w.getDirection();
+		float qa = w.steepness * w.amplitude;
+		c.wavevector = glm::vec4(d * w.frequency, d * qa);
+		c.amplitude = w.amplitude;
+		c.steepness = w.steepness;
+		c.wavelength = glm::two_pi<float>() / w.frequency;
+
+		// Wrap the phase in double precision so the per-point sum stays small
+		c.phase = (float)fmod(time * w.phase, glm::two_pi<double>());
+	}
+}
+
+// Folds the waves from their accumulated phases, moved on by an offset in
+// seconds that is at most a step long
+void WaveFrame::fold(const std::vector<Wave>& waves, const std::vector<double>& phases, double offset)
+{
+	fold(waves, 0.0);
+
+	for (int i = 0; i < count; i++)
+	{
+		double phase = fmod(phases[i] + offset * waves[i].phase, glm::two_pi<double>());
+		this->waves[i].phase = (float)(phase < 0.0 ? phase + glm::two_pi<double>() : phase);
+	}
+}
+
+// Blends two frames, fading the first out and the second in
+// Every wave function is linear in the amplitudes, so scaling them sums the
+// blended surface exactly
+// Both frames are sorted longest first and are merged in that order, so the
+// blended frame can still be truncated by distance
+void WaveFrame::mix(const WaveFrame& from, const WaveFrame& to, float t)
+{
+	count = from.count + to.count;
+	waves.assign((count + WAVE_BLOCK - 1) / WAVE_BLOCK * WAVE_BLOCK, WaveConstants());
+
+	int a = 0, b = 0;
+	for (int i = 0; i < count; i++)
+	{
+		bool takeFrom = b == to.count ||
+			(a < from.count && from.waves[a].wavelength >= to.waves[b].wavelength);
+		WaveConstants& w = waves[i];
+		w = takeFrom ? from.waves[a++] : to.waves[b++];
+
+		float weight = takeFrom ? 1.0f - t : t;
+		w.amplitude *= weight;
+		w.wavevector.z *= weight;
+		w.wavevector.w *= weight;
+	}
+}
+
+// Fraction of a wave left at a distance from the viewer
+// Matches fetchWave in waves.glsl
+float lodFade(const WaveConstants& w, float distance, float lodScale)
+{
+	if (lodScale <= 0.0f)
+		return 1.0f;
+
+	float start = w.wavelength * lodScale;
+	return 1.0f - glm::smoothstep(start, 2.0f * start, distance);
+}
+
+// Copy of the frame with the waves faded for a viewer at the given distance
+// The waves are sorted longest first, so the faded out waves are all at the
+// end and are truncated, letting the kernels sum fewer blocks
+WaveFrame WaveFrame::getLod(float distance, float lodScale) const
+{
+	WaveFrame lod;
+	while (lod.count < count && lodFade(waves[lod.count], distance, lodScale) > 0.0f)
+	{
+		lod.count++;
+	}
+	lod.waves.assign(waves.begin(), waves.begin() + lod.count);
+	lod.waves.resize((lod.count + WAVE_BLOCK - 1) / WAVE_BLOCK * WAVE_BLOCK);
+
+	for (int i = 0; i < lod.count; i++)
+	{
+		WaveConstants& w = lod.waves[i];
+		float fade = lodFade(w, distance, lodScale);
+		w.amplitude *= fade;
+		w.wavevector.z *= fade;
+		w.wavevector.w *= fade;
+	}
+
+	return lod;
+}
+
+#pragma endregion
+
+
+#pragma region WaveSet
+
+// Moves every phase on by a step
+void WaveSet::advance(double deltaTime)
+{
+	for (size_t i = 0; i < waves.size(); i++)
+	{
+		phases[i] = fmod(phases[i] + deltaTime * waves[i].phase, glm::two_pi<double>());
+	}
+}
+
+#pragma endregion
+
+
+#pragma region SurfaceProbes
+
+size_t SurfaceProbes::add(float x, float z)
+{
+	xs.push_back(x);
+	zs.push_back(z);
+	guessXs.push_back(x);
+	guessZs.push_back(z);
+	heights.push_back(0.0f);
+	return xs.size() - 1;
+}
+
+size_t SurfaceProbes::size() const
+{
+	return xs.size();
+}
+
+#pragma endregion
+
+
 #pragma region Water
 
-Water::Water() : planeRes(10), planeLen(10), waveFunction(SINE), wavesUboID(0) {};
+Water::Water() : planeRes(10), planeLen(10), waveFunction(SINE), lodScale(WAVE_LOD_SCALE),
+	normalQuality(VERTEX_NORMALS), geometry(MESH), gridVaoID(0), patchCount(0), currentSet(0), transition(0.0f), transitionTime(0.0f),
+	waveTime(0.0), wavesBufferID(0), wavesTexID(0), waveRange(WAVE_RANGE_SIZE),
+	wavesUploaded{ false, false }, uploadTimes{ 0.0, 0.0 }, drawTime(0.0) {};
 
 Water::Water(int planeRes, int planeLen, WaveFunction wf) 
-	: planeRes(planeRes), planeLen(planeLen), waveFunction(wf), wavesUboID(0) {};
+	: planeRes(planeRes), planeLen(planeLen), waveFunction(wf), lodScale(WAVE_LOD_SCALE),
+	normalQuality(VERTEX_NORMALS), geometry(MESH), gridVaoID(0), patchCount(0), currentSet(0), transition(0.0f), transitionTime(0.0f),
+	waveTime(0.0), wavesBufferID(0), wavesTexID(0), waveRange(WAVE_RANGE_SIZE),
+	wavesUploaded{ false, false }, uploadTimes{ 0.0, 0.0 }, drawTime(0.0) {};
 
 Water::~Water() {};
 
-void Water::generateMesh()
+// Triangulates the plane in scan order, one column of quads at a time
+std::vector<unsigned int> generateListIndices(int planeRes)
+{
+	std::vector<unsigned int> indices(planeRes * planeRes * 6);
+	for (int ti = 0, vi = 0, x = 0; x < planeRes; vi++, x++)
+	{
+		for (int z = 0; z < planeRes; ti += 6, vi++, z++)
+		{
+			// Set triangle indices in counterclockwise winding order
+			indices[ti] = vi;
+			indices[ti + 1] = vi + 1;
+			indices[ti + 2] = vi + planeRes + 1;
+			indices[ti + 3] = vi + planeRes + 1;
+			indices[ti + 4] = vi + 1;
+			indices[ti + 5] = vi + planeRes + 2;
+		}
+	}
+	return indices;
+}
+
+// Triangulates the plane as strips of INDEX_STRIP_WIDTH quads along x, stacked
+// along z, so each strip reuses the cached vertices of the one before it
+// The columns are grouped into tiles small enough for 16-bit indices relative
+// to each tile's first vertex
+// Returns false if a single column of vertices does not fit in a tile
+bool generateStripIndices(int planeRes, std::vector<unsigned short>& indices,
+	std::vector<IndexTile>& tiles)
+{
+	// Vertices are stored column by column, so a tile holds whole columns
+	int columnSize = planeRes + 1;
+	int tileWidth = PRIMITIVE_RESTART_INDEX / columnSize - 1;
+	if (tileWidth >= INDEX_STRIP_WIDTH)
+	{
+		tileWidth = tileWidth / INDEX_STRIP_WIDTH * INDEX_STRIP_WIDTH;
+	}
+	tileWidth = std::min(tileWidth, planeRes);
+	if (tileWidth < 1)
+		return false;
+
+	indices.clear();
+	tiles.clear();
+	for (int tileX = 0; tileX < planeRes; tileX += tileWidth)
+	{
+		IndexTile tile;
+		tile.offset = indices.size();
+		tile.baseVertex = tileX * columnSize;
+
+		int tileEnd = std::min(tileX + tileWidth, planeRes);
+		for (int stripX = tileX; stripX < tileEnd; stripX += INDEX_STRIP_WIDTH)
+		{
+			int stripEnd = std::min(stripX + INDEX_STRIP_WIDTH, tileEnd);
+			for (int z = 0; z < planeRes; z++)
+			{
+				// Alternate between the near and far row, matching the
+				// diagonal of the triangle list
+				for (int x = stripX; x <= stripEnd; x++)
+				{
+					int vi = (x - tileX) * columnSize + z;
+					indices.push_back((unsigned short)vi);
+					indices.push_back((unsigned short)(vi + 1));
+				}
+				indices.push_back(PRIMITIVE_RESTART_INDEX);
+			}
+		}
+
+		tile.count = (GLsizei)(indices.size() - tile.offset);
+		tiles.push_back(tile);
+	}
+	return true;
+}
+
+// Builds the vertices and indices of the plane mesh on the CPU, without
+// touching the GPU
+// Planes too large for 16-bit tiles get a 32-bit triangle list instead,
+// and return false
+bool Water::generatePlane(std::vector<unsigned short>& indices,
+	std::vector<IndexTile>& tiles, std::vector<unsigned int>& listIndices)
 {
 	float halfLen = planeLen * 0.5f;
 	float stepLen = (float)planeLen / planeRes;
 
 	// Initialize normals to up vector
-	normals.resize((planeRes + 1) * (planeRes + 1), glm::vec3(0.0f, 1.0f, 0.0f));
+	normals.assign((planeRes + 1) * (planeRes + 1), glm::vec3(0.0f, 1.0f, 0.0f));
 
 	// Initialize vertex attributes
 	positions.resize((planeRes + 1) * (planeRes + 1));
-	std::vector<glm::vec2> texCoords((planeRes + 1) * (planeRes + 1));
+	texCoords.resize((planeRes + 1) * (planeRes + 1));
 	for (int i = 0, x = 0; x <= planeRes; x++)
 	{
 		for (int z = 0; z <= planeRes; i++, z++)
@@ -64,33 +302,134 @@ void Water::generateMesh()
 			texCoords[i] = glm::vec2((float)x / planeRes, (float)z / planeRes);
 		}
 	}
-	
-	// Initialize indices to triangulate the plane
-	std::vector<unsigned int> indices(planeRes * planeRes * 6);
-	for (int ti = 0, vi = 0, x = 0; x < planeRes; vi++, x++)
+
+	indices.clear();
+	tiles.clear();
+	listIndices.clear();
+	if (generateStripIndices(planeRes, indices, tiles))
+		return true;
+
+	listIndices = generateListIndices(planeRes);
+	return false;
+}
+
+void Water::generateMesh()
+{
+	std::vector<unsigned short> indices;
+	std::vector<IndexTile> tiles;
+	std::vector<unsigned int> listIndices;
+	bool stripped = generatePlane(indices, tiles, listIndices);
+
+	// Stream the mesh, since the vertex data changes every frame when the
+	// surface is displaced on the CPU
+	mesh.setStreaming(true);
+
+	// Send the mesh data to the GPU
+	if (stripped)
 	{
-		for (int z = 0; z < planeRes; ti += 6, vi++, z++)
+		mesh.setupBuffers(positions, normals, texCoords, indices, tiles);
+	}
+	else
+	{
+		mesh.setupBuffers(positions, normals, texCoords, listIndices);
+	}
+}
+
+// Prints the vertex cache efficiency of the plane triangulations
+void Water::printIndexStats() const
+{
+	std::vector<unsigned int> listIndices = generateListIndices(planeRes);
+	std::cout << "Scan order triangle list: ACMR " <<
+		Mesh::computeAcmr(listIndices, GL_TRIANGLES) << ", " <<
+		listIndices.size() * sizeof(unsigned int) << " index bytes\n";
+
+	// Expand the tiles into absolute indices
+	std::vector<unsigned short> indices;
+	std::vector<IndexTile> tiles;
+	if (!generateStripIndices(planeRes, indices, tiles))
+	{
+		std::cout << "Plane too large for 16-bit index tiles\n";
+		return;
+	}
+
+	std::vector<unsigned int> stripIndices;
+	stripIndices.reserve(indices.size());
+	for (const IndexTile& tile : tiles)
+	{
+		for (GLsizei i = 0; i < tile.count; i++)
 		{
-			// Set triangle indices in counterclockwise winding order
-			indices[ti] = vi;
-			indices[ti + 1] = vi + 1;
-			indices[ti + 2] = vi + planeRes + 1;
-			indices[ti + 3] = vi + planeRes + 1;
-			indices[ti + 4] = vi + 1;
-			indices[ti + 5] = vi + planeRes + 2;
+			unsigned short index = indices[tile.offset + i];
+			stripIndices.push_back(index == PRIMITIVE_RESTART_INDEX ?
+				0xFFFFFFFF : index + tile.baseVertex);
 		}
 	}
+	std::cout << "Tiled triangle strips: ACMR " <<
+		Mesh::computeAcmr(stripIndices, GL_TRIANGLE_STRIP) << ", " <<
+		indices.size() * sizeof(unsigned short) << " index bytes, " <<
+		tiles.size() << " tiles\n";
+}
+
+// Sets up the plane to be generated in the vertex shader from gl_VertexID
+// and gl_InstanceID, with no vertex or index data
+// Each instance is one row of quads drawn as a triangle strip
+void Water::generateGrid()
+{
+	// Core profiles still need a vertex array bound to draw
+	if (gridVaoID == 0)
+	{
+		glGenVertexArrays(1, &gridVaoID);
+	}
+}
 
-	// Set the mesh to dynamic, since the vertex data will change frequently
-	mesh.setDynamic(true);
+// Sets up clipmap levels that follow the viewer, with the finest level
+// at the grid spacing of the plane
+void Water::generateClipmap(int levels, int resolution)
+{
+	clipmap = Clipmap(levels, resolution, (float)planeLen / planeRes);
+	clipmap.init();
+}
 
-	// Send the mesh data to the GPU
-	mesh.setupBuffers(positions, normals, texCoords, indices);
+// Sets up quadtree patches over the ocean, with the finest level
+// at the grid spacing of the plane
+void Water::generateQuadtree(int levels, int patchResolution)
+{
+	quadtree = Quadtree(levels, patchResolution, (float)planeLen / planeRes);
+	quadtree.init();
 }
 
-void Water::generateWaves(unsigned int seed, float medianWavelength, 
-	float medianAmplitude, float spreadAngle)
+// Sets up a grid of constant screen resolution, projected onto the water
+// plane from the camera every frame
+// Like the plane grid, it has no vertex or index data
+void Water::generateProjectedGrid()
 {
+	// Core profiles still need a vertex array bound to draw
+	if (gridVaoID == 0)
+	{
+		glGenVertexArrays(1, &gridVaoID);
+	}
+}
+
+// Sets up square patches over the plane that the tessellation stages
+// subdivide by their screen size and curvature, culling those out of view
+// Like the plane grid, the corners are generated from gl_VertexID
+// Needs a GL 4.0 context, see GLSL::supportsTessellation
+void Water::generatePatches(int patchCount)
+{
+	this->patchCount = patchCount;
+
+	// Core profiles still need a vertex array bound to draw
+	if (gridVaoID == 0)
+	{
+		glGenVertexArrays(1, &gridVaoID);
+	}
+}
+
+// Fills a wave set with random waves around the median wavelength and
+// amplitude, traveling within the spread angle of the wind
+void Water::generateWaveSet(WaveSet& set, unsigned int seed, float medianWavelength,
+	float medianAmplitude, float spreadAngle, int count)
+{
+	std::vector<Wave>& waves = set.waves;
 	std::mt19937 generator(seed);
 
 	float spread = glm::radians(spreadAngle);
@@ -113,7 +452,8 @@ void Water::generateWaves(unsigned int seed, float medianWavelength,
 
 	float baseAngle = 0.0f;
 
-	for (int i = 0; i < MAX_WAVES; i++)
+	waves.resize(count);
+	for (int i = 0; i < count; i++)
 	{
 		// Generate random wave parameters
 		float wavelength = wavelengthDist(generator);
@@ -131,15 +471,82 @@ void Water::generateWaves(unsigned int seed, float medianWavelength,
 		if (waveFunction == WaveFunction::GERSTNER)
 		{
 			float k = glm::two_pi<float>() / wavelength;
-			float maxSteepness = 1.0f / k * MAX_WAVES * amplitude;
+			float maxSteepness = 1.0f / k * count * amplitude;
 			steepness = glm::min(steepness, maxSteepness);
 		}
 
 		waves[i] = Wave(amplitude, wavelength, speed, steepness, direction);
 	}
 
-	// Send the waves to the GPU
-	setupWavesUbo();
+	// Sort the waves longest first, so the sum can be truncated by distance
+	std::sort(waves.begin(), waves.end(), [](const Wave& a, const Wave& b) {
+		return a.frequency < b.frequency;
+	});
+
+	// Start the phases at the current wave time, so new waves keep the
+	// clock running
+	set.phases.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		set.phases[i] = fmod(waveTime * waves[i].phase, glm::two_pi<double>());
+	}
+}
+
+// Replaces the waves at once, cancelling any transition
+void Water::generateWaves(unsigned int seed, float medianWavelength, 
+	float medianAmplitude, float spreadAngle, int count)
+{
+	generateWaveSet(waveSets[currentSet], seed, medianWavelength,
+		medianAmplitude, spreadAngle, count);
+	wavesUploaded[currentSet] = false;
+	transition = 0.0f;
+	transitionTime = 0.0f;
+
+	foldWaves(0.0);
+}
+
+// Fades new waves in over a duration in seconds of wave time, for changes
+// of weather
+// A transition that is still running is finished at once
+void Water::transitionWaves(unsigned int seed, float medianWavelength,
+	float medianAmplitude, float spreadAngle, int count, float duration)
+{
+	if (transitionTime > 0.0f)
+	{
+		currentSet = 1 - currentSet;
+	}
+
+	generateWaveSet(waveSets[1 - currentSet], seed, medianWavelength,
+		medianAmplitude, spreadAngle, count);
+	wavesUploaded[1 - currentSet] = false;
+	transition = 0.0f;
+	transitionTime = glm::max(duration, 1e-3f);
+
+	foldWaves(0.0);
+}
+
+
+// Generates a spectral ocean that tiles across the plane
+// Used instead of the summed waves when the wave function is SPECTRAL
+void Water::generateSpectrum(unsigned int seed, int resolution, float windSpeed,
+	glm::vec2 windDirection, SpectrumType type)
+{
+	spectrum.generate(seed, resolution, (float)planeLen, windSpeed, windDirection, type);
+	spectrum.update(waveTime);
+}
+
+// Sends the generated waves and spectral maps to the GPU
+// Generating leaves the GPU alone, so the simulation can also run without
+// a GL context
+void Water::setupBuffers()
+{
+	setupWavesBuffer();
+
+	if (spectrum.isGenerated())
+	{
+		spectrum.setupTextures();
+		spectrum.updateTextures();
+	}
 }
 
 float Water::sine(glm::vec3 position, Wave w, float time) const
@@ -171,70 +578,683 @@ glm::vec3 Water::gerstner(glm::vec3 position, Wave w, float time) const
 	return g;
 }
 
+// Single point query at an arbitrary time, evaluated with the batched kernels
+// Horizontal Gerstner offsets are dropped, see getSurfaceHeights
+// The spectral ocean can only be sampled at the time of its last update,
+// and only the current wave set is summed during a transition
 glm::vec3 Water::getDisplacement(glm::vec3 position, float time) const
 {
-	if (waveFunction == SINE)
+	if (waveFunction == SPECTRAL)
 	{
-		float displacement = 0.0f;
-		for (int i = 0; i < MAX_WAVES; i++)
+		float height;
+		spectrum.getDisplacements(&position.x, &position.z, 1, &height);
+		return glm::vec3(position.x, height, position.z);
+	}
+
+	WaveFrame pointFrame(waveSets[currentSet].waves, time);
+
+	float height;
+	WaveKernels::sumDisplacements(waveFunction, pointFrame, 
+		&position.x, &position.z, 1, &height);
+
+	return glm::vec3(position.x, height, position.z);
+}
+
+// Batched displacement query for structure-of-arrays (x, z) points
+// Heights are always written, dxs and dzs receive the horizontal offsets if given
+// Evaluated with the current wave frame
+void Water::getDisplacements(const float* xs, const float* zs, size_t count,
+	float* heights, float* dxs, float* dzs) const
+{
+	if (waveFunction == SPECTRAL)
+	{
+		spectrum.getDisplacements(xs, zs, count, heights, dxs, dzs);
+		return;
+	}
+
+	WaveKernels::sumDisplacements(waveFunction, frame, xs, zs, count,
+		heights, dxs, dzs);
+}
+
+// Batched displacement query for points seen from a distance
+// The waves too short to matter at that distance are faded out and skipped,
+// so pass the distance from the viewer to the nearest point of the batch
+void Water::getDisplacementsLod(const float* xs, const float* zs, size_t count,
+	float distance, float* heights, float* dxs, float* dzs) const
+{
+	if (waveFunction == SPECTRAL)
+	{
+		spectrum.getDisplacements(xs, zs, count, heights, dxs, dzs);
+		return;
+	}
+
+	WaveFrame lod = frame.getLod(distance, lodScale);
+	WaveKernels::sumDisplacements(waveFunction, lod, xs, zs, count,
+		heights, dxs, dzs);
+}
+
+// Batched query for the displacement, normal and Jacobian determinant of the
+// horizontal offsets at each (x, z) point, sharing one pass over the waves
+// The Jacobian is below zero where the surface folds over, like breaking crests
+void Water::getSurface(const float* xs, const float* zs, size_t count, float* heights,
+	glm::vec3* normals, float* jacobians, float* dxs, float* dzs) const
+{
+	float nxs[SURFACE_CHUNK], nys[SURFACE_CHUNK], nzs[SURFACE_CHUNK];
+
+	for (size_t start = 0; start < count; start += SURFACE_CHUNK)
+	{
+		size_t n = std::min((size_t)SURFACE_CHUNK, count - start);
+
+		if (waveFunction == SPECTRAL)
+		{
+			getSpectralSurface(xs + start, zs + start, n, heights + start,
+				normals + start, jacobians ? jacobians + start : nullptr,
+				dxs ? dxs + start : nullptr, dzs ? dzs + start : nullptr);
+			continue;
+		}
+
+		WaveKernels::SurfaceArrays out = { heights + start,
+			dxs ? dxs + start : nullptr, dzs ? dzs + start : nullptr,
+			nxs, nys, nzs, jacobians ? jacobians + start : nullptr };
+		WaveKernels::sumSurface(waveFunction, frame, xs + start, zs + start, n, out);
+
+		for (size_t i = 0; i < n; i++)
 		{
-			displacement += sine(position, waves[i], time);
+			normals[start + i] = glm::vec3(nxs[i], nys[i], nzs[i]);
 		}
-		return glm::vec3(position.x, displacement, position.z);
 	}
+}
 
-	else if (waveFunction == STEEP_SINE)
+// The spectrum only stores normals, so the Jacobian is taken from central
+// differences of the displacement one map texel apart
+void Water::getSpectralSurface(const float* xs, const float* zs, size_t count,
+	float* heights, glm::vec3* normals, float* jacobians, float* dxs, float* dzs) const
+{
+	float scratchDxs[SURFACE_CHUNK], scratchDzs[SURFACE_CHUNK];
+	dxs = dxs ? dxs : scratchDxs;
+	dzs = dzs ? dzs : scratchDzs;
+
+	spectrum.getDisplacements(xs, zs, count, heights, dxs, dzs);
+	for (size_t i = 0; i < count; i++)
 	{
-		float displacement = 0.0f;
-		for (int i = 0; i < MAX_WAVES; i++)
+		normals[i] = spectrum.sampleNormal(xs[i], zs[i]);
+	}
+
+	if (jacobians == nullptr)
+		return;
+
+	float e = spectrum.getLength() / spectrum.getResolution();
+	float sampleXs[SURFACE_CHUNK], sampleZs[SURFACE_CHUNK], ignored[SURFACE_CHUNK];
+	float plusDxs[SURFACE_CHUNK], plusDzs[SURFACE_CHUNK];
+	float minusDxs[SURFACE_CHUNK], minusDzs[SURFACE_CHUNK];
+	float dxdx[SURFACE_CHUNK], dzdx[SURFACE_CHUNK];
+
+	// Differentiate the horizontal offsets along x, then along z
+	for (int axis = 0; axis < 2; axis++)
+	{
+		glm::vec2 offset = axis == 0 ? glm::vec2(e, 0.0f) : glm::vec2(0.0f, e);
+
+		for (size_t i = 0; i < count; i++)
 		{
-			displacement += steepSine(position, waves[i], time);
+			sampleXs[i] = xs[i] + offset.x;
+			sampleZs[i] = zs[i] + offset.y;
 		}
-		return glm::vec3(position.x, displacement, position.z);
+		spectrum.getDisplacements(sampleXs, sampleZs, count, ignored, plusDxs, plusDzs);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			sampleXs[i] = xs[i] - offset.x;
+			sampleZs[i] = zs[i] - offset.y;
+		}
+		spectrum.getDisplacements(sampleXs, sampleZs, count, ignored, minusDxs, minusDzs);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			float ddx = (plusDxs[i] - minusDxs[i]) / (2.0f * e);
+			float ddz = (plusDzs[i] - minusDzs[i]) / (2.0f * e);
+			if (axis == 0)
+			{
+				dxdx[i] = ddx;
+				dzdx[i] = ddz;
+			}
+			else
+			{
+				jacobians[i] = (1.0f + dxdx[i]) * (1.0f + ddz) - ddx * dzdx[i];
+			}
+		}
+	}
+}
+
+// Reference implementation of getDisplacements using the per-wave functions
+// Only sums the current wave set
+void Water::getDisplacementsScalar(const float* xs, const float* zs, size_t count,
+	float time, float* heights, float* dxs, float* dzs) const
+{
+	if (waveFunction == SPECTRAL)
+	{
+		spectrum.getDisplacements(xs, zs, count, heights, dxs, dzs);
+		return;
 	}
 
-	else if (waveFunction == GERSTNER)
+	for (size_t i = 0; i < count; i++)
 	{
+		glm::vec3 position(xs[i], 0.0f, zs[i]);
 		glm::vec3 displacement(0.0f);
-		for (int i = 0; i < MAX_WAVES; i++)
+
+		for (const Wave& w : waveSets[currentSet].waves)
 		{
-			displacement += gerstner(position, waves[i], time);
+			if (waveFunction == SINE)
+				displacement.y += sine(position, w, time);
+			else if (waveFunction == STEEP_SINE)
+				displacement.y += steepSine(position, w, time);
+			else if (waveFunction == GERSTNER)
+				displacement += gerstner(position, w, time);
 		}
-		return glm::vec3(position.x, displacement.y, position.z);
+
+		heights[i] = displacement.y;
+		if (dxs) dxs[i] = displacement.x;
+		if (dzs) dzs[i] = displacement.z;
 	}
-	else
+}
+
+// Batched height of the displaced surface above each world-space (x, z) point
+// Gerstner waves and the spectral ocean move points horizontally, so the undisplaced point that lands
+// on (x, z) is found by the fixed-point iteration p = (x, z) - D(p), which
+// contracts as long as the summed wave steepness keeps the surface from looping.
+// guessXs and guessZs hold the previous solution on input and the new one on
+// output, so a warm start usually converges in one or two iterations.
+// The heights returned are always those of the guesses returned.
+void Water::getSurfaceHeights(const float* xs, const float* zs, size_t count,
+	float* heights, float* guessXs, float* guessZs,
+	int maxIterations, float tolerance) const
+{
+	// Without horizontal displacement the surface is already a height field
+	if (waveFunction != GERSTNER && waveFunction != SPECTRAL)
+	{
+		std::copy(xs, xs + count, guessXs);
+		std::copy(zs, zs + count, guessZs);
+		getDisplacements(xs, zs, count, heights);
+		return;
+	}
+
+	float dxs[SURFACE_CHUNK], dzs[SURFACE_CHUNK];
+
+	for (size_t start = 0; start < count; start += SURFACE_CHUNK)
 	{
-		return position;
+		size_t n = std::min((size_t)SURFACE_CHUNK, count - start);
+		const float* x = xs + start;
+		const float* z = zs + start;
+		float* h = heights + start;
+		float* gx = guessXs + start;
+		float* gz = guessZs + start;
+
+		getDisplacements(gx, gz, n, h, dxs, dzs);
+
+		for (int iteration = 0; iteration < maxIterations; iteration++)
+		{
+			// Stop before moving the guesses, so the heights stay those of the
+			// guesses kept for the next call
+			float maxResidual = 0.0f;
+			for (size_t i = 0; i < n; i++)
+			{
+				float rx = x[i] - dxs[i] - gx[i];
+				float rz = z[i] - dzs[i] - gz[i];
+				maxResidual = std::max(maxResidual, std::max(std::abs(rx), std::abs(rz)));
+			}
+
+			if (maxResidual <= tolerance)
+				break;
+
+			// Move each guess by its residual
+			for (size_t i = 0; i < n; i++)
+			{
+				gx[i] = x[i] - dxs[i];
+				gz[i] = z[i] - dzs[i];
+			}
+
+			getDisplacements(gx, gz, n, h, dxs, dzs);
+		}
 	}
 }
 
+void Water::getSurfaceHeights(SurfaceProbes& probes, int maxIterations) const
+{
+	getSurfaceHeights(probes.xs.data(), probes.zs.data(), probes.size(),
+		probes.heights.data(), probes.guessXs.data(), probes.guessZs.data(),
+		maxIterations);
+}
+
+int Water::getPlaneResolution() const
+{
+	return planeRes;
+}
+
+int Water::getPlaneLength() const
+{
+	return planeLen;
+}
+
+WaterGeometry Water::getGeometry() const
+{
+	return geometry;
+}
+
+// The generate functions only build the resources of a geometry, so several
+// can be kept and switched between here
+// The geometry must have been generated first
+void Water::setGeometry(WaterGeometry geometry)
+{
+	this->geometry = geometry;
+}
+
+// Largest horizontal and vertical displacement of the surface
+// Used to pad the bounds of culled geometry
+glm::vec2 Water::getDisplacementBounds() const
+{
+	glm::vec2 bounds(0.0f);
+
+	if (waveFunction == SPECTRAL)
+	{
+		for (const glm::vec4& d : spectrum.getDisplacementMap())
+		{
+			bounds.x = glm::max(bounds.x, glm::length(glm::vec2(d.x, d.z)));
+			bounds.y = glm::max(bounds.y, std::abs(d.y));
+		}
+		return bounds;
+	}
+
+	for (int i = 0; i < frame.count; i++)
+	{
+		const WaveConstants& w = frame.waves[i];
+		if (waveFunction == GERSTNER)
+			bounds.x += glm::length(glm::vec2(w.wavevector.z, w.wavevector.w));
+
+		// Steep sines reach twice the amplitude
+		bounds.y += (waveFunction == STEEP_SINE ? 2.0f : 1.0f) * w.amplitude;
+	}
+
+	return bounds;
+}
+
+float Water::getLodScale() const
+{
+	return lodScale;
+}
+
+// Zero or less disables the wave LOD
+void Water::setLodScale(float lodScale)
+{
+	this->lodScale = lodScale;
+}
+
+NormalQuality Water::getNormalQuality() const
+{
+	return normalQuality;
+}
+
+// Per pixel normals also coarsen the grids built at draw time
+void Water::setNormalQuality(NormalQuality normalQuality)
+{
+	this->normalQuality = normalQuality;
+}
+
 WaveFunction Water::getWaveFunction() const
 {
 	return waveFunction;
 }
 
-void Water::setupWavesUbo()
+// The spectral ocean is brought up to the wave time when it is switched to,
+// since it is only evolved while in use
+void Water::setWaveFunction(WaveFunction waveFunction)
+{
+	if (waveFunction == SPECTRAL && this->waveFunction != SPECTRAL && spectrum.isGenerated())
+	{
+		spectrum.update(waveTime);
+	}
+	this->waveFunction = waveFunction;
+}
+
+const Spectrum& Water::getSpectrum() const
+{
+	return spectrum;
+}
+
+const WaveFrame& Water::getWaveFrame() const
+{
+	return frame;
+}
+
+bool Water::isTransitioning() const
+{
+	return transitionTime > 0.0f;
+}
+
+// Folds the sets in use at an offset from the wave time, and blends them
+// for the CPU queries
+void Water::foldWaves(double offset)
+{
+	WaveSet& current = waveSets[currentSet];
+	current.frame.fold(current.waves, current.phases, offset);
+
+	if (transitionTime > 0.0f)
+	{
+		WaveSet& next = waveSets[1 - currentSet];
+		next.frame.fold(next.waves, next.phases, offset);
+		frame.mix(current.frame, next.frame, transition);
+	}
+	else
+	{
+		frame = current.frame;
+	}
+}
+
+// Advances the waves by one simulation step, folding them for the CPU
+// queries made during the step
+// The spectral ocean is evolved here rather than per frame, so the queries
+// see it at the step time
+void Water::advanceWaves(double deltaTime)
 {
-	// Initialize UBO with wave data
-	glGenBuffers(1, &wavesUboID);
-	glBindBuffer(GL_UNIFORM_BUFFER, wavesUboID);
-	glBufferData(GL_UNIFORM_BUFFER, MAX_WAVES * sizeof(Wave), waves, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	waveTime += deltaTime;
+	waveSets[currentSet].advance(deltaTime);
 
-	// Bind UBO	to binding point 1
-	glBindBufferBase(GL_UNIFORM_BUFFER, 1, wavesUboID);
+	// Fade the next set in, and make it current once it is in fully
+	if (transitionTime > 0.0f)
+	{
+		waveSets[1 - currentSet].advance(deltaTime);
+		transition += (float)deltaTime / transitionTime;
+		if (transition >= 1.0f)
+		{
+			currentSet = 1 - currentSet;
+			transition = 0.0f;
+			transitionTime = 0.0f;
+		}
+	}
+
+	foldWaves(0.0);
+
+	if (waveFunction == SPECTRAL && spectrum.isGenerated())
+	{
+		spectrum.update(waveTime);
+	}
 }
 
-void Water::updateWavesUbo()
+double Water::getWaveTime() const
 {
-	glBindBuffer(GL_UNIFORM_BUFFER, wavesUboID);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, MAX_WAVES * sizeof(Wave), waves);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return waveTime;
 }
 
-void Water::draw() const
+// Folds the waves at an offset from the last step for both the CPU queries
+// and the GPU, so the drawn surface can be placed between two steps
+// The spectral ocean is drawn as of the last step
+void Water::updateWaveFrame(double offset)
 {
-	mesh.draw();
+	foldWaves(offset);
+	drawTime = waveTime + offset;
+	updateWavesBuffer();
+
+	if (waveFunction == SPECTRAL && spectrum.isGenerated())
+	{
+		spectrum.updateTextures();
+	}
+}
+
+// Displaces the plane mesh on the CPU, for renderers that would run the
+// water vertex shader on the CPU anyway
+void Water::updateSurface()
+{
+	if (geometry != CPU_MESH)
+		return;
+
+	float* region = mesh.mapVertices();
+	if (region == nullptr)
+		return;
+
+	displaceSurface(region);
+	mesh.unmapVertices();
+}
+
+// Writes the displaced position and normal of every plane vertex, in the
+// layout of the streamed mesh
+// The vertices are split across the thread pool and summed in chunks by the
+// surface kernels, straight into the given buffer
+void Water::displaceSurface(float* vertices) const
+{
+	int columnSize = planeRes + 1;
+	float halfLen = planeLen * 0.5f;
+	float stepLen = (float)planeLen / planeRes;
+
+	ThreadPool::getInstance()->parallelFor(positions.size(), [&](size_t begin, size_t end) {
+		float xs[SURFACE_CHUNK], zs[SURFACE_CHUNK];
+		float heights[SURFACE_CHUNK], dxs[SURFACE_CHUNK], dzs[SURFACE_CHUNK];
+		glm::vec3 chunkNormals[SURFACE_CHUNK];
+
+		for (size_t start = begin; start < end; start += SURFACE_CHUNK)
+		{
+			size_t n = std::min((size_t)SURFACE_CHUNK, end - start);
+
+			// Vertices are stored column by column
+			for (size_t i = 0; i < n; i++)
+			{
+				size_t vi = start + i;
+				xs[i] = (vi / columnSize) * stepLen - halfLen;
+				zs[i] = (vi % columnSize) * stepLen - halfLen;
+			}
+
+			getSurface(xs, zs, n, heights, chunkNormals, nullptr, dxs, dzs);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				float* vertex = vertices + STREAM_ATTRIBUTES * (start + i);
+				vertex[0] = xs[i] + dxs[i];
+				vertex[1] = heights[i];
+				vertex[2] = zs[i] + dzs[i];
+				vertex[3] = chunkNormals[i].x;
+				vertex[4] = chunkNormals[i].y;
+				vertex[5] = chunkNormals[i].z;
+			}
+		}
+	});
+}
+
+// The wave constants are read by the shaders through a buffer texture,
+// so the wave count is not limited by the uniform block size
+// Each set has its own range of the buffer, holding its phases as of the
+// upload, which the shaders move on by the time since
+void Water::setupWavesBuffer()
+{
+	if (wavesBufferID == 0)
+	{
+		glGenBuffers(1, &wavesBufferID);
+		glGenTextures(1, &wavesTexID);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, wavesBufferID);
+	glBufferData(GL_TEXTURE_BUFFER, 2 * waveRange * sizeof(WaveTexels), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// Attach the buffer to the buffer texture
+	glBindTexture(GL_TEXTURE_BUFFER, wavesTexID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, wavesBufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	wavesUploaded[0] = wavesUploaded[1] = false;
+	drawTime = waveTime;
+	updateWavesBuffer();
+}
+
+// Doubles the range of each set until a set of the given count fits
+// Both ranges are copied into the new buffer, so the set not in use is kept
+void Water::growWavesBuffer(int count)
+{
+	int range = waveRange;
+	while (range < count)
+	{
+		range *= 2;
+	}
+	if (range == waveRange)
+		return;
+
+	GLuint bufferID;
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	glBufferData(GL_COPY_WRITE_BUFFER, 2 * range * sizeof(WaveTexels), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, wavesBufferID);
+	for (int i = 0; i < 2; i++)
+	{
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			i * waveRange * sizeof(WaveTexels), i * range * sizeof(WaveTexels),
+			waveRange * sizeof(WaveTexels));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(1, &wavesBufferID);
+	wavesBufferID = bufferID;
+	waveRange = range;
+
+	glBindTexture(GL_TEXTURE_BUFFER, wavesTexID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, wavesBufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Uploads a set in use into its range of the buffer when its waves are new,
+// or when its phases were taken long enough ago to cost precision
+// Otherwise nothing is sent, as the shaders move the phases on themselves
+void Water::updateWavesBuffer()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		const WaveSet& set = waveSets[i];
+		bool inUse = i == currentSet || transitionTime > 0.0f;
+		bool stale = !wavesUploaded[i] || waveTime - uploadTimes[i] > WAVE_REBASE_TIME;
+		if (!inUse || !stale || set.waves.empty())
+			continue;
+
+		int count = (int)set.waves.size();
+		growWavesBuffer(count);
+
+		// Fold the constants at the step time, where the phases are exact
+		WaveFrame base;
+		base.fold(set.waves, set.phases, 0.0);
+		std::vector<WaveTexels> texels(count);
+		for (int j = 0; j < count; j++)
+		{
+			const WaveConstants& w = base.waves[j];
+			texels[j].wavevector = w.wavevector;
+			texels[j].amplitude = w.amplitude;
+			texels[j].phase = w.phase;
+			texels[j].steepness = w.steepness;
+			texels[j].phaseSpeed = set.waves[j].phase;
+		}
+
+		glBindBuffer(GL_TEXTURE_BUFFER, wavesBufferID);
+		glBufferSubData(GL_TEXTURE_BUFFER, i * waveRange * sizeof(WaveTexels),
+			count * sizeof(WaveTexels), texels.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		wavesUploaded[i] = true;
+		uploadTimes[i] = waveTime;
+	}
+}
+
+void Water::bindWavesBuffer(GLint unit) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, wavesTexID);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Sets the range, weight and time since the upload of each wave set for the
+// shaders summing them
+// The shader must already be bound
+void Water::setWaveUniforms(const Shader& shader) const
+{
+	for (int i = 0; i < 2; i++)
+	{
+		std::string index = "[" + std::to_string(i) + "]";
+		bool isCurrent = i == currentSet;
+		bool inUse = isCurrent || transitionTime > 0.0f;
+
+		shader.setInt("waveOffsets" + index, i * waveRange);
+		shader.setInt("waveCounts" + index, inUse ? waveSets[i].frame.count : 0);
+		shader.setFloat("waveWeights" + index, isCurrent ? 1.0f - transition : transition);
+		shader.setFloat("waveElapsed" + index, (float)(drawTime - uploadTimes[i]));
+	}
+}
+
+// Sets the geometry uniforms of the water shader and draws the surface
+// The shader must already be bound
+void Water::draw(const Shader& shader, const Camera& camera) const
+{
+	bindWavesBuffer(WAVE_BUFFER_UNIT);
+
+	if (waveFunction == SPECTRAL)
+	{
+		spectrum.bindTextures(DISPLACEMENT_MAP_UNIT, NORMAL_MAP_UNIT);
+	}
+
+	shader.setInt("waterGeometry", geometry);
+
+	// The CPU displaced mesh has no undisplaced positions to evaluate the
+	// waves at
+	bool pixelNormals = normalQuality == PIXEL_NORMALS && geometry != CPU_MESH;
+	int coarsening = pixelNormals ? PIXEL_NORMAL_COARSENING : 1;
+	shader.setBool("pixelNormals", pixelNormals);
+
+	if (geometry == CLIPMAP)
+	{
+		clipmap.draw(shader, camera.getPosition());
+	}
+	else if (geometry == QUADTREE)
+	{
+		quadtree.draw(shader, camera, getDisplacementBounds());
+	}
+	else if (geometry == GRID)
+	{
+		int gridRes = glm::max(planeRes / coarsening, 1);
+		shader.setInt("planeRes", gridRes);
+		shader.setFloat("planeLen", (float)planeLen);
+
+		glBindVertexArray(gridVaoID);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (gridRes + 1), gridRes);
+		glBindVertexArray(0);
+	}
+	else if (geometry == PROJECTED)
+	{
+		// Size the grid to the screen, so the vertex count never depends on
+		// how much of the ocean is in view
+		float gridScale = (1.0f + PROJECTED_GRID_MARGIN) / (PROJECTED_GRID_PIXELS * coarsening);
+		int gridResX = (int)ceil(camera.getScreenWidth() * gridScale);
+		int gridResY = (int)ceil(camera.getScreenHeight() * gridScale);
+		glm::mat4 viewProjection = camera.getProjectionMatrix() * camera.getViewMatrix();
+
+		shader.setMat4("invViewProjection", glm::inverse(viewProjection));
+		shader.setVec2("projectedRes", glm::vec2(gridResX, gridResY));
+		shader.setFloat("projectedMargin", PROJECTED_GRID_MARGIN);
+
+		glBindVertexArray(gridVaoID);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (gridResX + 1), gridResY);
+		glBindVertexArray(0);
+	}
+	else if (geometry == TESSELLATED)
+	{
+		shader.setInt("patchCount", patchCount);
+		shader.setFloat("planeLen", (float)planeLen);
+		shader.setVec2("screenSize", glm::vec2(camera.getScreenWidth(), camera.getScreenHeight()));
+		shader.setFloat("tessPixels", TESS_PIXELS * coarsening);
+		shader.setFloat("tessCurvature", TESS_CURVATURE);
+		shader.setFloat("maxTessLevel", TESS_MAX_LEVEL);
+		shader.setVec2("displacementBounds", getDisplacementBounds());
+
+		GLSL::patchParameteri(GL_PATCH_VERTICES, 4);
+		glBindVertexArray(gridVaoID);
+		glDrawArrays(GL_PATCHES, 0, 4 * patchCount * patchCount);
+		glBindVertexArray(0);
+	}
+	else
+	{
+		mesh.draw();
+	}
 }
 
 #pragma endregion
\ No newline at end of file
@@ -5,16 +5,92 @@
 
 #include <vector>
 #include "Mesh.h"
-#include "Time.h"
+#include "Spectrum.h"
+#include "Camera.h"
+#include "Clipmap.h"
+#include "Quadtree.h"
 
-#define MAX_WAVES 16
+#define DEFAULT_WAVES 16
+#define SURFACE_ITERATIONS 3
 
+// Frames are padded with flat waves to a multiple of this, so the kernels
+// can sum whole blocks of waves
+#define WAVE_BLOCK 4
+
+// Waves each set's range of the wave buffer starts with room for
+// The buffer holds both sets, so a new sea state can usually be faded in
+// without reallocating it
+#define WAVE_RANGE_SIZE 64
+
+// Seconds of wave time after which a set in use is uploaded again, so the
+// phases the shaders move on from stay precise in single precision
+#define WAVE_REBASE_TIME 10.0
+
+// Seconds a new wave set takes to fade in
+#define WAVE_TRANSITION_TIME 10.0f
+
+// Waves start fading out once the viewer is this many wavelengths away,
+// and are gone at twice the distance
+#define WAVE_LOD_SCALE 100.0f
+
+// Quads per strip of the plane mesh, short enough for both rows of a strip
+// to fit in the vertex cache, so the next strip finds its near row cached
+#define INDEX_STRIP_WIDTH (VERTEX_CACHE_SIZE / 2 - 1)
+
+// Screen pixels per quad of the projected grid, and how far the grid extends
+// past the edges of the screen to cover waves displaced inwards
+#define PROJECTED_GRID_PIXELS 4
+#define PROJECTED_GRID_MARGIN 0.1f
+
+// Coarse patches per side of the plane for the tessellated surface, and the
+// screen pixels per subdivided edge they are refined towards
+// The finest level matches the grid spacing of the plane
+#define TESS_PATCHES 16
+#define TESS_PIXELS 8.0f
+#define TESS_MAX_LEVEL 64.0f
+
+// How many times finer an edge gets per radian the surface normal turns
+// along it, so crests get more vertices than flat water at the same distance
+#define TESS_CURVATURE 4.0f
+
+// How many times coarser the grids built at draw time are along each side
+// when the normals are computed per pixel, which keeps the specular detail
+// the dense grid was needed for
+#define PIXEL_NORMAL_COARSENING 4
+
+// Texture units of the maps sampled by the water shader
+#define DISPLACEMENT_MAP_UNIT 1
+#define NORMAL_MAP_UNIT 2
+
+// Texture unit of the wave constants buffer
+#define WAVE_BUFFER_UNIT 3
+
+
+// How the water surface is drawn
+enum WaterGeometry
+{
+	MESH,		// Plane stored in a mesh
+	GRID,		// Plane generated in the vertex shader
+	CLIPMAP,	// Nested grids following the viewer
+	QUADTREE,	// Patches refined by screen-space error and culled
+	PROJECTED,	// Screen-space grid projected onto the water plane
+	CPU_MESH,	// Plane stored in a mesh and displaced on the CPU
+	TESSELLATED,	// Coarse patches subdivided by the tessellation stages
+};
 
 enum WaveFunction
 {
 	SINE,
 	STEEP_SINE,
 	GERSTNER,
+	SPECTRAL,
+};
+
+// Where the shading normal of the water is computed
+enum NormalQuality
+{
+	VERTEX_NORMALS,	// Interpolated from the displaced vertices
+	PIXEL_NORMALS,	// Evaluated again from the waves or maps for each pixel
 };
 
 // Aligned for std140 alignment
@@ -36,6 +112,70 @@ struct alignas(16) Wave
 };
 
 
+// Wave constants folded with the current time, summed by the CPU kernels
+struct alignas(16) WaveConstants
+{
+	glm::vec4 wavevector;	// {Dx * frequency, Dz * frequency, Q * A * Dx, Q * A * Dz}
+	float amplitude;
+	float phase;			// time * phase, wrapped to [0, 2pi)
+	float steepness;
+	float wavelength;
+};
+
+// A wave as stored in the wave buffer, two RGBA32F texels
+// The shaders move the phase on by the time since the set was uploaded, and
+// get the wavelength back from the wavevector
+struct alignas(16) WaveTexels
+{
+	glm::vec4 wavevector;	// As in WaveConstants
+	float amplitude;
+	float phase;			// At the upload, wrapped to [0, 2pi)
+	float steepness;
+	float phaseSpeed;		// Radians per second
+};
+
+// Snapshot of all waves for one frame, built once per tick
+struct WaveFrame
+{
+	int count;
+	std::vector<WaveConstants> waves;	// Padded to a multiple of WAVE_BLOCK
+
+	WaveFrame();
+	WaveFrame(const std::vector<Wave>& waves, double time);
+
+	void fold(const std::vector<Wave>& waves, double time);
+	void fold(const std::vector<Wave>& waves, const std::vector<double>& phases, double offset);
+	void mix(const WaveFrame& from, const WaveFrame& to, float t);
+	WaveFrame getLod(float distance, float lodScale) const;
+};
+
+// Waves of one sea state, with the phase of each wave at the wave time
+// Each phase is wrapped to [0, 2pi) on its own, so it stays precise however
+// long the simulation runs
+struct WaveSet
+{
+	std::vector<Wave> waves;
+	std::vector<double> phases;
+	WaveFrame frame;	// Folded without the blend
+
+	void advance(double deltaTime);
+};
+
+
+// Points on the water surface that are queried every frame
+// The undisplaced guesses carry over between frames to warm start the
+// inversion of the horizontal Gerstner displacement
+struct SurfaceProbes
+{
+	std::vector<float> xs, zs;
+	std::vector<float> guessXs, guessZs;
+	std::vector<float> heights;
+
+	size_t add(float x, float z);
+	size_t size() const;
+};
+
+
 class Water
 {
 public:
@@ -43,31 +183,109 @@ public:
 	Water(int planeRes, int planeLen, WaveFunction waveFunction);
 	~Water();
 
+	bool generatePlane(std::vector<unsigned short>& indices,
+		std::vector<IndexTile>& tiles, std::vector<unsigned int>& listIndices);
 	void generateMesh();
+	void generateGrid();
+	void printIndexStats() const;
+	void generateClipmap(int levels = CLIPMAP_LEVELS, int resolution = CLIPMAP_RES);
+	void generateQuadtree(int levels = QUADTREE_LEVELS, int patchResolution = QUADTREE_PATCH_RES);
+	void generateProjectedGrid();
+	void generatePatches(int patchCount = TESS_PATCHES);
 	void generateWaves(unsigned int seed, float medianWavelength, 
-		float medianAmplitude, float spreadAngle);
+		float medianAmplitude, float spreadAngle, int count = DEFAULT_WAVES);
+	void transitionWaves(unsigned int seed, float medianWavelength,
+		float medianAmplitude, float spreadAngle, int count = DEFAULT_WAVES,
+		float duration = WAVE_TRANSITION_TIME);
+	void generateSpectrum(unsigned int seed, int resolution, float windSpeed,
+		glm::vec2 windDirection, SpectrumType type);
+	void setupBuffers();
 
 	float sine(glm::vec3 position, Wave w, float time) const;
 	float steepSine(glm::vec3 position, Wave w, float time) const;
 	glm::vec3 gerstner(glm::vec3 position, Wave w, float tiem) const;
 	glm::vec3 getDisplacement(glm::vec3 position, float time) const;
+	void getDisplacements(const float* xs, const float* zs, size_t count,
+		float* heights, float* dxs = nullptr, float* dzs = nullptr) const;
+	void getDisplacementsLod(const float* xs, const float* zs, size_t count,
+		float distance, float* heights, float* dxs = nullptr, float* dzs = nullptr) const;
+	void getSurface(const float* xs, const float* zs, size_t count, float* heights,
+		glm::vec3* normals, float* jacobians = nullptr,
+		float* dxs = nullptr, float* dzs = nullptr) const;
+	void getDisplacementsScalar(const float* xs, const float* zs, size_t count,
+		float time, float* heights, float* dxs = nullptr, float* dzs = nullptr) const;
+	void getSurfaceHeights(const float* xs, const float* zs, size_t count,
+		float* heights, float* guessXs, float* guessZs,
+		int maxIterations = SURFACE_ITERATIONS, float tolerance = 1e-4f) const;
+	void getSurfaceHeights(SurfaceProbes& probes,
+		int maxIterations = SURFACE_ITERATIONS) const;
+	int getPlaneResolution() const;
+	int getPlaneLength() const;
+	WaterGeometry getGeometry() const;
+	void setGeometry(WaterGeometry geometry);
+	glm::vec2 getDisplacementBounds() const;
+	float getLodScale() const;
+	void setLodScale(float lodScale);
+	NormalQuality getNormalQuality() const;
+	void setNormalQuality(NormalQuality normalQuality);
 	WaveFunction getWaveFunction() const;
+	void setWaveFunction(WaveFunction waveFunction);
+	const Spectrum& getSpectrum() const;
+	const WaveFrame& getWaveFrame() const;
+	bool isTransitioning() const;
 
-	void setupWavesUbo();
-	void updateWavesUbo();
-	void draw() const;
+	void advanceWaves(double deltaTime);
+	double getWaveTime() const;
+	void updateWaveFrame(double offset = 0.0);
+	void updateSurface();
+	void displaceSurface(float* vertices) const;
+	void setupWavesBuffer();
+	void updateWavesBuffer();
+	void bindWavesBuffer(GLint unit) const;
+	void setWaveUniforms(const Shader& shader) const;
+	void draw(const Shader& shader, const Camera& camera) const;
 
 private:
+	void generateWaveSet(WaveSet& set, unsigned int seed, float medianWavelength,
+		float medianAmplitude, float spreadAngle, int count);
+	void foldWaves(double offset);
+	void growWavesBuffer(int count);
+	void getSpectralSurface(const float* xs, const float* zs, size_t count,
+		float* heights, glm::vec3* normals, float* jacobians, float* dxs, float* dzs) const;
+
 	int planeRes, planeLen;
 	WaveFunction waveFunction;
+	float lodScale;
+	NormalQuality normalQuality;
+
+	WaterGeometry geometry;
+	GLuint gridVaoID;
+	int patchCount;
+	Clipmap clipmap;
+	Quadtree quadtree;
 
 	Mesh mesh;
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texCoords;
 
-	Wave waves[MAX_WAVES];
-	GLuint wavesUboID;
+	// The current wave set, and the next one while it fades in
+	// Each set has its own range of the wave buffer
+	WaveSet waveSets[2];
+	int currentSet;
+	float transition;		// How far the next set has faded in, from 0 to 1
+	float transitionTime;	// Zero when no transition is running
+	double waveTime;
+
+	// Both sets blended for the CPU queries
+	WaveFrame frame;
+	GLuint wavesBufferID, wavesTexID;
+	int waveRange;			// Waves each set's range of the buffer holds
+	bool wavesUploaded[2];	// Whether each set's range holds its current waves
+	double uploadTimes[2];	// Wave time each set was last uploaded at
+	double drawTime;		// Wave time the shaders sum the waves at
+
+	Spectrum spectrum;
 };
 
 #endif // WATER_H
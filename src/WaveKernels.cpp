@@ -0,0 +1,682 @@
+#include "WaveKernels.h"
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WAVE_KERNELS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WAVE_KERNELS_SSE2
+#endif
+
+
+// The math functions are forced inline into each wave, so the compiler
+// can schedule the chains of neighbouring registers together
+#if defined(_MSC_VER)
+#define KERNEL_INLINE __forceinline
+#else
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#endif
+
+
+#pragma region Instruction sets
+
+// Each instruction set exposes the same small set of operations so the
+// math functions and kernels below only have to be written once
+
+#if defined(WAVE_KERNELS_AVX2)
+
+struct SimdAvx2
+{
+	typedef __m256 Float;
+	typedef __m256i Int;
+	static const int width = 8;
+
+	static Float set1(float f) { return _mm256_set1_ps(f); }
+	static Float load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+
+	static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+#if defined(__FMA__)
+	static Float fmadd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+	static Float fmadd(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+	static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	static Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+
+	static Float bitAnd(Float a, Float b) { return _mm256_and_ps(a, b); }
+	static Float bitOr(Float a, Float b) { return _mm256_or_ps(a, b); }
+	static Float bitXor(Float a, Float b) { return _mm256_xor_ps(a, b); }
+	static Float lessThan(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+
+	static Int roundToInt(Float a) { return _mm256_cvtps_epi32(a); }
+	static Float toFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+	static Int asInt(Float a) { return _mm256_castps_si256(a); }
+	static Float asFloat(Int a) { return _mm256_castsi256_ps(a); }
+	static Int intAnd(Int a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+	static Int intOr(Int a, int b) { return _mm256_or_si256(a, _mm256_set1_epi32(b)); }
+	static Int intAdd(Int a, int b) { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+	static Int intEqual(Int a, int b) { return _mm256_cmpeq_epi32(a, _mm256_set1_epi32(b)); }
+	template <int n> static Int shiftLeft(Int a) { return _mm256_slli_epi32(a, n); }
+	template <int n> static Int shiftRight(Int a) { return _mm256_srli_epi32(a, n); }
+};
+
+typedef SimdAvx2 SimdDefault;
+
+#elif defined(WAVE_KERNELS_SSE2)
+
+struct SimdSse2
+{
+	typedef __m128 Float;
+	typedef __m128i Int;
+	static const int width = 4;
+
+	static Float set1(float f) { return _mm_set1_ps(f); }
+	static Float load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, Float v) { _mm_storeu_ps(p, v); }
+
+	static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+	static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	static Float fmadd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+	static Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+	static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+	static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+
+	static Float bitAnd(Float a, Float b) { return _mm_and_ps(a, b); }
+	static Float bitOr(Float a, Float b) { return _mm_or_ps(a, b); }
+	static Float bitXor(Float a, Float b) { return _mm_xor_ps(a, b); }
+	static Float lessThan(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+	static Float select(Float mask, Float a, Float b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	static Int roundToInt(Float a) { return _mm_cvtps_epi32(a); }
+	static Float toFloat(Int a) { return _mm_cvtepi32_ps(a); }
+	static Int asInt(Float a) { return _mm_castps_si128(a); }
+	static Float asFloat(Int a) { return _mm_castsi128_ps(a); }
+	static Int intAnd(Int a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+	static Int intOr(Int a, int b) { return _mm_or_si128(a, _mm_set1_epi32(b)); }
+	static Int intAdd(Int a, int b) { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+	static Int intEqual(Int a, int b) { return _mm_cmpeq_epi32(a, _mm_set1_epi32(b)); }
+	template <int n> static Int shiftLeft(Int a) { return _mm_slli_epi32(a, n); }
+	template <int n> static Int shiftRight(Int a) { return _mm_srli_epi32(a, n); }
+};
+
+typedef SimdSse2 SimdDefault;
+
+#else
+
+// Fallback for targets without SSE2, using the standard math functions
+struct SimdScalar
+{
+	typedef float Float;
+	static const int width = 1;
+
+	static Float set1(float f) { return f; }
+	static Float load(const float* p) { return *p; }
+	static void store(float* p, Float v) { *p = v; }
+
+	static Float add(Float a, Float b) { return a + b; }
+	static Float sub(Float a, Float b) { return a - b; }
+	static Float mul(Float a, Float b) { return a * b; }
+	static Float fmadd(Float a, Float b, Float c) { return a * b + c; }
+	static Float div(Float a, Float b) { return a / b; }
+	static Float sqrt(Float a) { return std::sqrt(a); }
+	static Float max(Float a, Float b) { return std::max(a, b); }
+};
+
+typedef SimdScalar SimdDefault;
+
+#endif
+
+#pragma endregion
+
+
+#pragma region Math functions
+
+// Polynomial approximations adapted from the Cephes single precision library.
+// Arguments are reduced to [-pi/4, pi/4] with a three-part Cody-Waite
+// reduction, which stays accurate for the phases reached by the simulation.
+
+template <typename S>
+KERNEL_INLINE void simdSinCos(typename S::Float x, typename S::Float& s, typename S::Float& c)
+{
+	typedef typename S::Float Float;
+	typedef typename S::Int Int;
+
+	// Reduce to a quadrant and a remainder in [-pi/4, pi/4]
+	Int q = S::roundToInt(S::mul(x, S::set1(0.636619772f)));
+	Float qf = S::toFloat(q);
+	Float r = S::fmadd(qf, S::set1(-1.5703125f), x);
+	r = S::fmadd(qf, S::set1(-4.837512969970703125e-4f), r);
+	r = S::fmadd(qf, S::set1(-7.54978995489188216e-8f), r);
+	Float r2 = S::mul(r, r);
+
+	// Evaluate both polynomials on the remainder
+	Float ps = S::fmadd(r2, S::set1(-1.9515295891e-4f), S::set1(8.3321608736e-3f));
+	ps = S::fmadd(ps, r2, S::set1(-1.6666654611e-1f));
+	ps = S::fmadd(S::mul(ps, r2), r, r);
+
+	Float pc = S::fmadd(r2, S::set1(2.443315711809948e-5f), S::set1(-1.388731625493765e-3f));
+	pc = S::fmadd(pc, r2, S::set1(4.166664568298827e-2f));
+	pc = S::fmadd(S::mul(pc, r2), r2, S::fmadd(r2, S::set1(-0.5f), S::set1(1.0f)));
+
+	// Swap the polynomials in odd quadrants and fix the signs
+	Float swap = S::asFloat(S::intEqual(S::intAnd(q, 1), 1));
+	Float sinSign = S::asFloat(S::template shiftLeft<30>(S::intAnd(q, 2)));
+	Float cosSign = S::asFloat(S::template shiftLeft<30>(S::intAnd(S::intAdd(q, 1), 2)));
+	s = S::bitXor(S::select(swap, pc, ps), sinSign);
+	c = S::bitXor(S::select(swap, ps, pc), cosSign);
+}
+
+// Only feeds simdPow, so it trades the last digits for a short polynomial
+// Accurate to about 3e-8 absolute
+template <typename S>
+KERNEL_INLINE typename S::Float simdLog(typename S::Float x)
+{
+	typedef typename S::Float Float;
+	typedef typename S::Int Int;
+
+	// Split into exponent and mantissa in [0.5, 1)
+	x = S::max(x, S::set1(1.17549435e-38f));
+	Int xi = S::asInt(x);
+	Float e = S::toFloat(S::intAdd(S::template shiftRight<23>(xi), -0x7e));
+	x = S::asFloat(S::intOr(S::intAnd(xi, ~0x7f800000), 0x3f000000));
+
+	// Shift the mantissa to [sqrt(0.5), sqrt(2))
+	Float small = S::lessThan(x, S::set1(0.707106781186547524f));
+	e = S::sub(e, S::bitAnd(small, S::set1(1.0f)));
+	x = S::add(x, S::bitAnd(small, x));
+
+	// log(x) = 2 * atanh(t) with t = (x - 1) / (x + 1), and |t| < 0.172
+	Float one = S::set1(1.0f);
+	Float t = S::div(S::sub(x, one), S::add(x, one));
+	Float t2 = S::mul(t, t);
+	Float y = S::fmadd(S::set1(2.0f / 7.0f), t2, S::set1(2.0f / 5.0f));
+	y = S::fmadd(y, t2, S::set1(2.0f / 3.0f));
+	y = S::fmadd(y, t2, S::set1(2.0f));
+	y = S::mul(y, t);
+
+	y = S::fmadd(e, S::set1(-2.12194440e-4f), y);
+	return S::fmadd(e, S::set1(0.693359375f), y);
+}
+
+// Only feeds simdPow, so the polynomial stops at degree 5
+// Accurate to about 3e-6 relative
+template <typename S>
+KERNEL_INLINE typename S::Float simdExp(typename S::Float x)
+{
+	typedef typename S::Float Float;
+	typedef typename S::Int Int;
+
+	x = S::min(S::max(x, S::set1(-87.3f)), S::set1(88.3f));
+
+	// Reduce to x = n * ln(2) + r with |r| <= ln(2) / 2
+	Int n = S::roundToInt(S::mul(x, S::set1(1.44269504088896341f)));
+	Float nf = S::toFloat(n);
+	x = S::fmadd(nf, S::set1(-0.693359375f), x);
+	x = S::fmadd(nf, S::set1(2.12194440e-4f), x);
+
+	Float y = S::fmadd(S::set1(1.0f / 120.0f), x, S::set1(1.0f / 24.0f));
+	y = S::fmadd(y, x, S::set1(1.0f / 6.0f));
+	y = S::fmadd(y, x, S::set1(0.5f));
+	y = S::fmadd(S::mul(y, x), x, S::add(x, S::set1(1.0f)));
+
+	// Scale by 2^n
+	Float scale = S::asFloat(S::template shiftLeft<23>(S::intAdd(n, 0x7f)));
+	return S::mul(y, scale);
+}
+
+// Raises base in [0, 1] to a positive exponent
+template <typename S>
+KERNEL_INLINE typename S::Float simdPow(typename S::Float base, typename S::Float exponent)
+{
+	typedef typename S::Float Float;
+
+	Float result = simdExp<S>(S::mul(exponent, simdLog<S>(base)));
+
+	// log(0) is clamped, so force an exact zero for zero bases
+	Float zero = S::lessThan(base, S::set1(1e-30f));
+	return S::select(zero, S::set1(0.0f), result);
+}
+
+#if !defined(WAVE_KERNELS_AVX2) && !defined(WAVE_KERNELS_SSE2)
+
+template <>
+void simdSinCos<SimdScalar>(float x, float& s, float& c)
+{
+	s = std::sin(x);
+	c = std::cos(x);
+}
+
+template <>
+float simdPow<SimdScalar>(float base, float exponent)
+{
+	return std::pow(base, exponent);
+}
+
+#endif
+
+#pragma endregion
+
+
+#pragma region Kernels
+
+// Registers of points the displacement kernels sum together
+// The surface kernels keep one, as their sums already fill the registers
+#define DISPLACEMENT_REGISTERS 2
+
+// Running sums of the displacement for a register of points
+template <typename S>
+struct DisplacementSums
+{
+	typename S::Float h, dx, dz;
+
+	DisplacementSums() : h(S::set1(0.0f)), dx(S::set1(0.0f)), dz(S::set1(0.0f)) {}
+};
+
+// Running sums of the displacement and its partial derivatives
+// The horizontal Gerstner derivatives are symmetric, since both
+// Q * A * Dx * Dz * frequency terms are equal, so one sum covers both
+template <typename S>
+struct SurfaceSums : DisplacementSums<S>
+{
+	typename S::Float hx, hz;		// Slope of the height
+	typename S::Float sxx, szz, sxz;	// Derivatives of the horizontal offsets, negated
+
+	SurfaceSums() : hx(S::set1(0.0f)), hz(S::set1(0.0f)),
+		sxx(S::set1(0.0f)), szz(S::set1(0.0f)), sxz(S::set1(0.0f)) {}
+};
+
+// Adds one wave to the running sums for a register of points
+// The wave function is a template parameter, so the branches below are
+// resolved at compile time
+template <typename S, WaveFunction F>
+KERNEL_INLINE void addWave(const WaveConstants& w, typename S::Float x, typename S::Float z,
+	DisplacementSums<S>& sums)
+{
+	typedef typename S::Float Float;
+
+	// f = (D . xz) * frequency + time * phase
+	Float f = S::fmadd(x, S::set1(w.wavevector.x),
+		S::fmadd(z, S::set1(w.wavevector.y), S::set1(w.phase)));
+
+	Float s, c;
+	simdSinCos<S>(f, s, c);
+
+	if (F == STEEP_SINE)
+	{
+		// 2A * ((sin(f) + 1) / 2)^k
+		Float base = S::fmadd(s, S::set1(0.5f), S::set1(0.5f));
+		Float p = simdPow<S>(base, S::set1(w.steepness));
+		sums.h = S::fmadd(p, S::set1(2.0f * w.amplitude), sums.h);
+	}
+	else
+	{
+		sums.h = S::fmadd(s, S::set1(w.amplitude), sums.h);
+	}
+
+	if (F == GERSTNER)
+	{
+		sums.dx = S::fmadd(c, S::set1(w.wavevector.z), sums.dx);
+		sums.dz = S::fmadd(c, S::set1(w.wavevector.w), sums.dz);
+	}
+}
+
+// Adds one wave and its partial derivatives, sharing the sine and cosine
+// Matches sumSines, sumSteepSine and sumGerstner in waves.glsl
+template <typename S, WaveFunction F>
+KERNEL_INLINE void addWave(const WaveConstants& w, typename S::Float x, typename S::Float z,
+	SurfaceSums<S>& sums)
+{
+	typedef typename S::Float Float;
+
+	Float f = S::fmadd(x, S::set1(w.wavevector.x),
+		S::fmadd(z, S::set1(w.wavevector.y), S::set1(w.phase)));
+
+	Float s, c;
+	simdSinCos<S>(f, s, c);
+
+	// Derivative of the height along the wave, per unit of wavevector
+	Float slope;
+	if (F == STEEP_SINE)
+	{
+		// Share the power term between the height and its derivative
+		Float base = S::max(S::fmadd(s, S::set1(0.5f), S::set1(0.5f)), S::set1(1e-6f));
+		Float powTerm = simdPow<S>(base, S::set1(w.steepness - 1.0f));
+		sums.h = S::fmadd(S::mul(powTerm, base), S::set1(2.0f * w.amplitude), sums.h);
+		slope = S::mul(S::mul(powTerm, c), S::set1(w.steepness * w.amplitude));
+	}
+	else
+	{
+		sums.h = S::fmadd(s, S::set1(w.amplitude), sums.h);
+		slope = S::mul(c, S::set1(w.amplitude));
+	}
+	sums.hx = S::fmadd(slope, S::set1(w.wavevector.x), sums.hx);
+	sums.hz = S::fmadd(slope, S::set1(w.wavevector.y), sums.hz);
+
+	if (F == GERSTNER)
+	{
+		sums.dx = S::fmadd(c, S::set1(w.wavevector.z), sums.dx);
+		sums.dz = S::fmadd(c, S::set1(w.wavevector.w), sums.dz);
+		sums.sxx = S::fmadd(s, S::set1(w.wavevector.z * w.wavevector.x), sums.sxx);
+		sums.szz = S::fmadd(s, S::set1(w.wavevector.w * w.wavevector.y), sums.szz);
+		sums.sxz = S::fmadd(s, S::set1(w.wavevector.z * w.wavevector.y), sums.sxz);
+	}
+}
+
+// Adds one wave to R registers of points
+// The math functions are long dependency chains, so the registers are
+// interleaved to let their chains overlap
+template <typename S, WaveFunction F, int R, typename Sums>
+inline void addWaves(const WaveConstants& w, const typename S::Float* x,
+	const typename S::Float* z, Sums* sums)
+{
+	for (int r = 0; r < R; r++)
+	{
+		addWave<S, F>(w, x[r], z[r], sums[r]);
+	}
+}
+
+// Unrolls the sum over waves [I, N) at compile time
+template <typename S, WaveFunction F, int R, int I, int N>
+struct WaveSum
+{
+	template <typename Sums>
+	static inline void add(const WaveConstants* waves, const typename S::Float* x,
+		const typename S::Float* z, Sums* sums)
+	{
+		addWaves<S, F, R>(waves[I], x, z, sums);
+		WaveSum<S, F, R, I + 1, N>::add(waves, x, z, sums);
+	}
+};
+
+template <typename S, WaveFunction F, int R, int N>
+struct WaveSum<S, F, R, N, N>
+{
+	template <typename Sums>
+	static inline void add(const WaveConstants* waves, const typename S::Float* x,
+		const typename S::Float* z, Sums* sums) {}
+};
+
+// Marks kernels that read the wave count from the frame at runtime
+#define DYNAMIC_WAVES -1
+
+// Sums the first N waves of the frame over R registers of points
+template <typename S, WaveFunction F, int R, int N>
+struct FrameSum
+{
+	template <typename Sums>
+	static inline void add(const WaveFrame& frame, const typename S::Float* x,
+		const typename S::Float* z, Sums* sums)
+	{
+		WaveSum<S, F, R, 0, N>::add(frame.waves.data(), x, z, sums);
+	}
+};
+
+// Sums all waves of the frame, unrolled within each block
+template <typename S, WaveFunction F, int R>
+struct FrameSum<S, F, R, DYNAMIC_WAVES>
+{
+	template <typename Sums>
+	static inline void add(const WaveFrame& frame, const typename S::Float* x,
+		const typename S::Float* z, Sums* sums)
+	{
+		const WaveConstants* waves = frame.waves.data();
+		size_t count = frame.waves.size();
+		for (size_t i = 0; i < count; i += WAVE_BLOCK)
+		{
+			WaveSum<S, F, R, 0, WAVE_BLOCK>::add(waves + i, x, z, sums);
+		}
+	}
+};
+
+// Sums N waves over DISPLACEMENT_REGISTERS registers of points
+template <typename S, WaveFunction F, int N>
+inline void sumBlock(const WaveFrame& frame, const float* xs, const float* zs,
+	float* heights, float* dxs, float* dzs)
+{
+	const int registers = DISPLACEMENT_REGISTERS;
+	typename S::Float x[registers], z[registers];
+	for (int r = 0; r < registers; r++)
+	{
+		x[r] = S::load(xs + r * S::width);
+		z[r] = S::load(zs + r * S::width);
+	}
+
+	DisplacementSums<S> sums[registers];
+	FrameSum<S, F, registers, N>::add(frame, x, z, sums);
+
+	for (int r = 0; r < registers; r++)
+	{
+		S::store(heights + r * S::width, sums[r].h);
+		if (dxs) S::store(dxs + r * S::width, sums[r].dx);
+		if (dzs) S::store(dzs + r * S::width, sums[r].dz);
+	}
+}
+
+template <typename S, WaveFunction F, int N>
+void sumDisplacementsImpl(const WaveFrame& frame, const float* xs, const float* zs,
+	size_t count, float* heights, float* dxs, float* dzs)
+{
+	const size_t width = S::width * DISPLACEMENT_REGISTERS;
+
+	// Process full registers directly from the caller's arrays
+	size_t i = 0;
+	for (; i + width <= count; i += width)
+	{
+		sumBlock<S, F, N>(frame, xs + i, zs + i, heights + i,
+			dxs ? dxs + i : nullptr, dzs ? dzs + i : nullptr);
+	}
+
+	// Pad the remaining points into a full register
+	if (i < count)
+	{
+		float x[width] = { 0.0f }, z[width] = { 0.0f };
+		float h[width], dx[width], dz[width];
+
+		size_t remaining = count - i;
+		for (size_t j = 0; j < remaining; j++)
+		{
+			x[j] = xs[i + j];
+			z[j] = zs[i + j];
+		}
+
+		sumBlock<S, F, N>(frame, x, z, h, dx, dz);
+
+		for (size_t j = 0; j < remaining; j++)
+		{
+			heights[i + j] = h[j];
+			if (dxs) dxs[i + j] = dx[j];
+			if (dzs) dzs[i + j] = dz[j];
+		}
+	}
+}
+
+// Sums N waves and their derivatives over one register of points
+template <typename S, WaveFunction F, int N>
+inline void sumSurfaceBlock(const WaveFrame& frame, const float* xs, const float* zs,
+	const WaveKernels::SurfaceArrays& out, size_t offset)
+{
+	typedef typename S::Float Float;
+
+	Float x = S::load(xs), z = S::load(zs);
+	SurfaceSums<S> sums;
+	FrameSum<S, F, 1, N>::add(frame, &x, &z, &sums);
+
+	// Tangent T = [1 - sxx, hx, -sxz] and binormal B = [-sxz, hz, 1 - szz]
+	// N = B x T, whose y component is the Jacobian of the horizontal offsets
+	Float one = S::set1(1.0f);
+	Float tx = S::sub(one, sums.sxx);
+	Float bz = S::sub(one, sums.szz);
+	Float nx = S::sub(S::set1(0.0f), S::fmadd(sums.hz, sums.sxz, S::mul(bz, sums.hx)));
+	Float ny = S::sub(S::mul(bz, tx), S::mul(sums.sxz, sums.sxz));
+	Float nz = S::sub(S::set1(0.0f), S::fmadd(sums.sxz, sums.hx, S::mul(sums.hz, tx)));
+
+	// Normalize by the length alone, so the normal stays flipped where
+	// crests fold over
+	Float length = S::sqrt(S::fmadd(nx, nx, S::fmadd(ny, ny, S::mul(nz, nz))));
+	Float scale = S::div(one, S::max(length, S::set1(1e-12f)));
+
+	if (out.heights) S::store(out.heights + offset, sums.h);
+	if (out.dxs) S::store(out.dxs + offset, sums.dx);
+	if (out.dzs) S::store(out.dzs + offset, sums.dz);
+	if (out.normalXs) S::store(out.normalXs + offset, S::mul(nx, scale));
+	if (out.normalYs) S::store(out.normalYs + offset, S::mul(ny, scale));
+	if (out.normalZs) S::store(out.normalZs + offset, S::mul(nz, scale));
+	if (out.jacobians) S::store(out.jacobians + offset, ny);
+}
+
+template <typename S, WaveFunction F, int N>
+void sumSurfaceImpl(const WaveFrame& frame, const float* xs, const float* zs,
+	size_t count, const WaveKernels::SurfaceArrays& out)
+{
+	const size_t width = S::width;
+
+	// Process full registers directly from the caller's arrays
+	size_t i = 0;
+	for (; i + width <= count; i += width)
+	{
+		sumSurfaceBlock<S, F, N>(frame, xs + i, zs + i, out, i);
+	}
+
+	// Pad the remaining points into a full register
+	if (i < count)
+	{
+		float x[width] = { 0.0f }, z[width] = { 0.0f };
+		float h[width], dx[width], dz[width], nx[width], ny[width], nz[width], j[width];
+		WaveKernels::SurfaceArrays padded = { h, dx, dz, nx, ny, nz, j };
+
+		size_t remaining = count - i;
+		for (size_t k = 0; k < remaining; k++)
+		{
+			x[k] = xs[i + k];
+			z[k] = zs[i + k];
+		}
+
+		sumSurfaceBlock<S, F, N>(frame, x, z, padded, 0);
+
+		for (size_t k = 0; k < remaining; k++)
+		{
+			if (out.heights) out.heights[i + k] = h[k];
+			if (out.dxs) out.dxs[i + k] = dx[k];
+			if (out.dzs) out.dzs[i + k] = dz[k];
+			if (out.normalXs) out.normalXs[i + k] = nx[k];
+			if (out.normalYs) out.normalYs[i + k] = ny[k];
+			if (out.normalZs) out.normalZs[i + k] = nz[k];
+			if (out.jacobians) out.jacobians[i + k] = j[k];
+		}
+	}
+}
+
+// Table of kernels for every multiple of WAVE_BLOCK waves up to
+// SPECIALIZED_WAVES, followed by the runtime count kernel
+template <WaveFunction F, int... Blocks>
+WaveKernels::SumKernel selectKernel(int blocks, std::integer_sequence<int, Blocks...>)
+{
+	static const WaveKernels::SumKernel kernels[] = {
+		&sumDisplacementsImpl<SimdDefault, F, Blocks * WAVE_BLOCK>...,
+		&sumDisplacementsImpl<SimdDefault, F, DYNAMIC_WAVES>
+	};
+	return kernels[blocks];
+}
+
+template <WaveFunction F, int... Blocks>
+WaveKernels::SurfaceKernel selectSurfaceKernel(int blocks, std::integer_sequence<int, Blocks...>)
+{
+	static const WaveKernels::SurfaceKernel kernels[] = {
+		&sumSurfaceImpl<SimdDefault, F, Blocks * WAVE_BLOCK>...,
+		&sumSurfaceImpl<SimdDefault, F, DYNAMIC_WAVES>
+	};
+	return kernels[blocks];
+}
+
+#pragma endregion
+
+
+namespace WaveKernels
+{
+
+const char* getInstructionSet()
+{
+#if defined(WAVE_KERNELS_AVX2)
+	return "AVX2";
+#elif defined(WAVE_KERNELS_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+// Round up to whole blocks, the frame pads the extra waves with flat ones
+// Counts past the specialized kernels all share the last table entry
+static int getKernelBlocks(int count)
+{
+	const int maxBlocks = SPECIALIZED_WAVES / WAVE_BLOCK;
+	return glm::min((count + WAVE_BLOCK - 1) / WAVE_BLOCK, maxBlocks + 1);
+}
+
+SumKernel getSumKernel(WaveFunction waveFunction, int count)
+{
+	int blocks = getKernelBlocks(count);
+	auto sequence = std::make_integer_sequence<int, SPECIALIZED_WAVES / WAVE_BLOCK + 1>();
+
+	switch (waveFunction)
+	{
+	case STEEP_SINE:
+		return selectKernel<STEEP_SINE>(blocks, sequence);
+	case GERSTNER:
+		return selectKernel<GERSTNER>(blocks, sequence);
+	case SINE:
+	default:
+		return selectKernel<SINE>(blocks, sequence);
+	}
+}
+
+void sumDisplacements(WaveFunction waveFunction, const WaveFrame& frame,
+	const float* xs, const float* zs, size_t count,
+	float* heights, float* dxs, float* dzs)
+{
+	// Dispatch once for the whole batch
+	SumKernel kernel = getSumKernel(waveFunction, frame.count);
+	kernel(frame, xs, zs, count, heights, dxs, dzs);
+}
+
+SurfaceKernel getSurfaceKernel(WaveFunction waveFunction, int count)
+{
+	int blocks = getKernelBlocks(count);
+	auto sequence = std::make_integer_sequence<int, SPECIALIZED_WAVES / WAVE_BLOCK + 1>();
+
+	switch (waveFunction)
+	{
+	case STEEP_SINE:
+		return selectSurfaceKernel<STEEP_SINE>(blocks, sequence);
+	case GERSTNER:
+		return selectSurfaceKernel<GERSTNER>(blocks, sequence);
+	case SINE:
+	default:
+		return selectSurfaceKernel<SINE>(blocks, sequence);
+	}
+}
+
+void sumSurface(WaveFunction waveFunction, const WaveFrame& frame,
+	const float* xs, const float* zs, size_t count, const SurfaceArrays& out)
+{
+	// Dispatch once for the whole batch
+	SurfaceKernel kernel = getSurfaceKernel(waveFunction, frame.count);
+	kernel(frame, xs, zs, count, out);
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef WAVE_KERNELS_H
+#define WAVE_KERNELS_H
+
+#include <cstddef>
+#include "Water.h"
+
+// Wave counts up to this get a fully unrolled kernel per block count,
+// larger counts loop over the blocks at runtime
+#define SPECIALIZED_WAVES 16
+
+
+namespace WaveKernels
+{
+	// Name of the instruction set the kernels were compiled for
+	const char* getInstructionSet();
+
+	typedef void (*SumKernel)(const WaveFrame& frame, const float* xs, const float* zs,
+		size_t count, float* heights, float* dxs, float* dzs);
+
+	// Returns the kernel specialized for the wave function and wave count
+	SumKernel getSumKernel(WaveFunction waveFunction, int count);
+
+	// Sums all waves at each (x, z) point
+	// dxs and dzs are optional and receive the horizontal Gerstner offsets
+	void sumDisplacements(WaveFunction waveFunction, const WaveFrame& frame,
+		const float* xs, const float* zs, size_t count,
+		float* heights, float* dxs = nullptr, float* dzs = nullptr);
+
+	// Per-point outputs of the surface kernels, any of which may be null
+	// The Jacobian determinant of the horizontal offsets drops below zero
+	// where Gerstner crests fold over
+	struct SurfaceArrays
+	{
+		float* heights;
+		float* dxs;
+		float* dzs;
+		float* normalXs;
+		float* normalYs;
+		float* normalZs;
+		float* jacobians;
+	};
+
+	typedef void (*SurfaceKernel)(const WaveFrame& frame, const float* xs, const float* zs,
+		size_t count, const SurfaceArrays& out);
+
+	SurfaceKernel getSurfaceKernel(WaveFunction waveFunction, int count);
+
+	// Sums all waves and their partial derivatives at each (x, z) point in one
+	// pass, giving the displacement, normal and Jacobian together
+	void sumSurface(WaveFunction waveFunction, const WaveFrame& frame,
+		const float* xs, const float* zs, size_t count, const SurfaceArrays& out);
+}
+
+#endif // WAVE_KERNELS_H
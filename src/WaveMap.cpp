@@ -0,0 +1,130 @@
+#include "WaveMap.h"
+
+#include <iostream>
+
+
+WaveMap::WaveMap() : 
+	resolution(0), origin(0.0f), length(0.0f), 
+	fboID(0), vaoID(0), displacementTexID(0), normalTexID(0) {}
+
+WaveMap::~WaveMap() {}
+
+bool WaveMap::init(const std::string& vShaderFile, const std::string& fShaderFile,
+	int resolution, glm::vec2 origin, float length)
+{
+	this->resolution = resolution;
+	this->origin = origin;
+	this->length = length;
+
+	if (!shader.init(vShaderFile, fShaderFile))
+	{
+		return false;
+	}
+
+	// Create a floating point target for each map
+	GLuint* ids[2] = { &displacementTexID, &normalTexID };
+	for (GLuint* id : ids)
+	{
+		glGenTextures(1, id);
+		glBindTexture(GL_TEXTURE_2D, *id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution, resolution, 0,
+			GL_RGBA, GL_FLOAT, nullptr);
+
+		// The maps do not tile, so hold the edges past the covered square
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Render to both maps at once
+	GLint previousFbo;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+
+	glGenFramebuffers(1, &fboID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboID);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
+		GL_TEXTURE_2D, displacementTexID, 0);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 
+		GL_TEXTURE_2D, normalTexID, 0);
+
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	bool complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFbo);
+
+	if (!complete)
+	{
+		std::cerr << "Wave map framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	// The fullscreen triangle is generated from gl_VertexID,
+	// but core profiles still need a vertex array bound to draw
+	glGenVertexArrays(1, &vaoID);
+
+	return true;
+}
+
+void WaveMap::render(const Water& water, glm::vec3 viewerPosition)
+{
+	// Save the state changed by the pass
+	GLint previousFbo, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboID);
+	glViewport(0, 0, resolution, resolution);
+	glDisable(GL_DEPTH_TEST);
+
+	water.bindWavesBuffer(WAVE_BUFFER_UNIT);
+
+	shader.bind();
+	shader.setInt("waveFunction", water.getWaveFunction());
+	water.setWaveUniforms(shader);
+	shader.setVec3("lodOrigin", viewerPosition);
+	shader.setFloat("lodScale", water.getLodScale());
+	shader.setVec2("mapOrigin", origin);
+	shader.setFloat("texelLength", length / resolution);
+
+	glBindVertexArray(vaoID);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	shader.unbind();
+
+	// Restore the previous state
+	if (depthTest)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFbo);
+}
+
+void WaveMap::bindTextures(GLint displacementUnit, GLint normalUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + displacementUnit);
+	glBindTexture(GL_TEXTURE_2D, displacementTexID);
+	glActiveTexture(GL_TEXTURE0 + normalUnit);
+	glBindTexture(GL_TEXTURE_2D, normalTexID);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+int WaveMap::getResolution() const
+{
+	return resolution;
+}
+
+glm::vec2 WaveMap::getOrigin() const
+{
+	return origin;
+}
+
+float WaveMap::getLength() const
+{
+	return length;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef WAVE_MAP_H
+#define WAVE_MAP_H
+
+#include <string>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Water.h"
+
+// Texels per side of the wave map
+#define WAVE_MAP_RES 512
+
+
+// Render pass that sums the waves once per texel into displacement and
+// normal maps, so the water vertices only sample the maps and the wave cost
+// scales with the map resolution instead of the vertex count
+// Unlike the spectral maps, a sum of directional waves does not tile,
+// so the maps cover a fixed square of the water plane
+class WaveMap
+{
+public:
+	WaveMap();
+	~WaveMap();
+
+	bool init(const std::string& vShaderFile, const std::string& fShaderFile,
+		int resolution, glm::vec2 origin, float length);
+	void render(const Water& water, glm::vec3 viewerPosition);
+	void bindTextures(GLint displacementUnit, GLint normalUnit) const;
+
+	int getResolution() const;
+	glm::vec2 getOrigin() const;
+	float getLength() const;
+
+private:
+	int resolution;
+	glm::vec2 origin;	// World xz of the first texel center
+	float length;		// Texel centers repeat every length / resolution meters
+
+	Shader shader;
+	GLuint fboID, vaoID;
+	GLuint displacementTexID, normalTexID;
+};
+
+#endif // WAVE_MAP_H
@@ -4,6 +4,16 @@
 
 #include <iostream>
 
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// Offscreen context, kept out of the header so only EGL builds need EGL
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLSurface eglSurface = EGL_NO_SURFACE;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
 
 void error_callback(int error, const char *description)
 {
@@ -56,6 +66,15 @@ bool WindowManager::init(int const width, int const height)
 	std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
 	std::cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
+	if (!GLSL::loadTessellation((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Tessellation shaders not supported" << std::endl;
+	}
+	if (!GLSL::loadBufferStorage((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Persistent buffer mapping not supported" << std::endl;
+	}
+
 	// Set vsync
 	glfwSwapInterval(1);
 
@@ -68,12 +87,141 @@ bool WindowManager::init(int const width, int const height)
 	return true;
 }
 
+// Creates a GL context without a visible window or vsync, for rendering
+// into a framebuffer object on machines without a display
+// EGL builds need no window system at all, using Mesa's surfaceless platform
+// when it exists, while other builds fall back to a hidden GLFW window
+bool WindowManager::initOffscreen(int const width, int const height)
+{
+	offscreen = true;
+
+#ifdef USE_EGL
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+	{
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (eglDisplay == EGL_NO_DISPLAY)
+	{
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (!eglInitialize(eglDisplay, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cerr << "Failed to initialize EGL" << std::endl;
+		return false;
+	}
+
+	// A pbuffer when the display has one, otherwise no surface at all, since
+	// the frames are drawn into a framebuffer object either way
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = nullptr;
+	EGLint configCount = 0;
+	eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount);
+	if (configCount > 0)
+	{
+		EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttribs);
+	}
+	else
+	{
+		config = nullptr;
+	}
+
+	// The shaders need GL 4.2, but take the newest core context there is
+	const EGLint versions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 2 }, { 3, 3 } };
+	for (const EGLint* version : versions)
+	{
+		EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION, version[0],
+			EGL_CONTEXT_MINOR_VERSION, version[1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+		eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+		if (eglContext != EGL_NO_CONTEXT)
+		{
+			break;
+		}
+	}
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+	{
+		std::cerr << "Failed to create an EGL context" << std::endl;
+		return false;
+	}
+
+	GLADloadproc load = (GLADloadproc)eglGetProcAddress;
+#else
+	glfwSetErrorCallback(error_callback);
+
+	if (!glfwInit())
+	{
+		return false;
+	}
+
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+	windowHandle = glfwCreateWindow(width, height, "Ocean Simulator", nullptr, nullptr);
+	if (!windowHandle)
+	{
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(windowHandle);
+
+	// Run uncapped
+	glfwSwapInterval(0);
+
+	GLADloadproc load = (GLADloadproc)glfwGetProcAddress;
+#endif
+
+	if (!gladLoadGLLoader(load))
+	{
+		std::cerr << "Failed to initialize GLAD" << std::endl;
+		return false;
+	}
+
+	std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
+	std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+
+	if (!GLSL::loadTessellation(load))
+	{
+		std::cout << "Tessellation shaders not supported" << std::endl;
+	}
+	if (!GLSL::loadBufferStorage(load))
+	{
+		std::cout << "Persistent buffer mapping not supported" << std::endl;
+	}
+
+	return true;
+}
+
 void WindowManager::shutdown()
 {
+#ifdef USE_EGL
+	if (offscreen)
+	{
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(eglDisplay, eglContext);
+		if (eglSurface != EGL_NO_SURFACE)
+		{
+			eglDestroySurface(eglDisplay, eglSurface);
+		}
+		eglTerminate(eglDisplay);
+		return;
+	}
+#endif
 	glfwDestroyWindow(windowHandle);
 	glfwTerminate();
 }
 
+bool WindowManager::isOffscreen() const
+{
+	return offscreen;
+}
+
 void WindowManager::setEventCallbacks(EventCallbacks * callbacks_in)
 {
 	callbacks = callbacks_in;
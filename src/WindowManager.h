@@ -47,7 +47,9 @@ public:
 	WindowManager& operator= (const WindowManager&) = delete;
 
 	bool init(int const width, int const height);
+	bool initOffscreen(int const width, int const height);
 	void shutdown();
+	bool isOffscreen() const;
 
 	void setEventCallbacks(EventCallbacks *callbacks);
 	GLFWwindow *getHandle();
@@ -55,6 +57,7 @@ public:
 protected:
 	GLFWwindow *windowHandle = nullptr;
 	EventCallbacks *callbacks = nullptr;
+	bool offscreen = false;
 
 private:
 	// This class implements the singleton design pattern
@@ -18,6 +18,17 @@
 #include "HierarchyNode.h"
 #include "WindowManager.h"
 #include "Time.h"
+#include "WaveMap.h"
+#include "Buoyancy.h"
+#include "Replay.h"
+#include "HeightSampler.h"
+#include "OffscreenTarget.h"
+
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
 
 #include "stb_image.h"
 
@@ -66,6 +77,8 @@ public:
 	Shader simpleShader;
 	Shader textureShader;
 	Shader waterShader;
+	Shader waterSurfaceShader;
+	Shader waterTessShader;
 	Shader cubemapShader;
 
 	// Textures
@@ -84,6 +97,8 @@ public:
 
 	// Game objects
 	Water water;
+	WaveMap waveMap;
+	HeightSampler heightSampler;
 	GameObject cube1;
 	GameObject surfboard1;
 	GameObject surfboard2;
@@ -92,11 +107,29 @@ public:
 	std::vector<GameObject> dummyObjects;
 	HierarchyNode dummyRoot;
 
-	// Animation data
-	float accumulatedTime = 0.0f;
+	// Rigid bodies floating the surfboards, with the surfboard transforms
+	// relative to them
+	Buoyancy buoyancy;
+	size_t surfboardBodies[3];
+
+	// Simulation setup, and the inputs of the run when recording or playing
+	// it back
+	ReplaySettings settings = { 2, 20.0f, 0.025f, 35.0f, DEFAULT_WAVES, WaveFunction::GERSTNER };
+	Replay replay;
+	glm::vec2 frameRotation = glm::vec2(0.0f);
+
+	// Wave sets faded in since the start
+	int weather = 0;
 
 	// Debug flags
 	bool debugNormals = false;
+	bool useWaveMap = true;
+	bool useGpuHeights = false;
+	bool gpuHeightsReady = false;
+
+	// Plane mesh geometry in the C cycle, built the first time it is picked
+	WaterGeometry meshGeometry = WaterGeometry::MESH;
+	bool meshGenerated = false;
 
 
 	void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -149,6 +182,86 @@ public:
 			if (action == GLFW_PRESS) debugNormals = true;
 			else if (action == GLFW_RELEASE) debugNormals = false;
 		}
+		// Toggle between the summed waves and the spectral ocean
+		if (key == GLFW_KEY_F && action == GLFW_PRESS)
+		{
+			water.setWaveFunction(water.getWaveFunction() == WaveFunction::SPECTRAL ?
+				WaveFunction::GERSTNER : WaveFunction::SPECTRAL);
+		}
+		// Fade in the waves of the next weather
+		if (key == GLFW_KEY_R && action == GLFW_PRESS && !replay.isPlaying())
+		{
+			setWeather(weather + 1);
+		}
+		// Cycle between the quadtree patches, the clipmap rings, the projected grid,
+		// the tessellated patches when the GPU supports them, the shader generated
+		// grid and the plane mesh
+		if (key == GLFW_KEY_C && action == GLFW_PRESS)
+		{
+			WaterGeometry geometry = water.getGeometry();
+			if (geometry == WaterGeometry::QUADTREE)
+			{
+				water.setGeometry(WaterGeometry::CLIPMAP);
+			}
+			else if (geometry == WaterGeometry::CLIPMAP)
+			{
+				water.setGeometry(WaterGeometry::PROJECTED);
+			}
+			else if (geometry == WaterGeometry::PROJECTED && GLSL::supportsTessellation())
+			{
+				water.setGeometry(WaterGeometry::TESSELLATED);
+			}
+			else if (geometry == WaterGeometry::PROJECTED || geometry == WaterGeometry::TESSELLATED)
+			{
+				water.setGeometry(WaterGeometry::GRID);
+			}
+			else if (geometry == WaterGeometry::GRID)
+			{
+				if (!meshGenerated)
+				{
+					water.generateMesh();
+					meshGenerated = true;
+				}
+				water.setGeometry(meshGeometry);
+			}
+			else
+			{
+				water.setGeometry(WaterGeometry::QUADTREE);
+			}
+		}
+		// Print the vertex cache efficiency of the plane mesh
+		if (key == GLFW_KEY_I && action == GLFW_PRESS)
+		{
+			water.printIndexStats();
+		}
+		// Toggle between CPU queries and GPU readbacks for the floating heights
+		// Replays only cover the CPU queries
+		if (key == GLFW_KEY_H && action == GLFW_PRESS && !replay.isPlaying() && !replay.isRecording())
+		{
+			if (!useGpuHeights && !gpuHeightsReady)
+			{
+				std::cerr << "GPU height sampler unavailable, staying on CPU heights" << std::endl;
+			}
+			else
+			{
+				useGpuHeights = !useGpuHeights;
+				buoyancy.setHeightSampler(useGpuHeights ? &heightSampler : nullptr);
+				std::cout << (useGpuHeights ? "Floating on GPU heights\n" : "Floating on CPU heights\n");
+			}
+		}
+		// Toggle between the wave map pass and summing waves per vertex
+		if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		{
+			useWaveMap = !useWaveMap;
+		}
+		// Compare per vertex normals on the dense grids with per pixel normals
+		// on grids coarsened to match
+		if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		{
+			bool pixelNormals = water.getNormalQuality() == NormalQuality::VERTEX_NORMALS;
+			water.setNormalQuality(pixelNormals ? NormalQuality::PIXEL_NORMALS : NormalQuality::VERTEX_NORMALS);
+			std::cout << (pixelNormals ? "Per pixel normals\n" : "Per vertex normals\n");
+		}
 		if (key == GLFW_KEY_Z)
 		{
 			if (action == GLFW_PRESS) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -167,6 +280,12 @@ public:
 
 	void mouseCallback(GLFWwindow* window, double xPos, double yPos)
 	{
+		// The camera follows the replay while one is playing
+		if (replay.isPlaying())
+		{
+			return;
+		}
+
 		if (firstMouse)
 		{
 			xPrev = xPos;
@@ -187,6 +306,7 @@ public:
 
 		// Update camera rotation and view matrix
 		camera.updateRotation(xOffset, yOffset);
+		frameRotation += glm::vec2(xOffset, yOffset);
 	}
 
 	void resizeCallback(GLFWwindow *window, int width, int height)
@@ -224,6 +344,12 @@ public:
 		simpleShader.init(resourceDir + "/simple.vert", resourceDir + "/simple.frag");
 		textureShader.init(resourceDir + "/texture.vert", resourceDir + "/texture.frag");
 		waterShader.init(resourceDir + "/water.vert", resourceDir + "/water.frag");
+		waterSurfaceShader.init(resourceDir + "/water_surface.vert", resourceDir + "/water.frag");
+		if (GLSL::supportsTessellation())
+		{
+			waterTessShader.init(resourceDir + "/water_patch.vert", resourceDir + "/water.tesc",
+				resourceDir + "/water.tese", resourceDir + "/water.frag");
+		}
 		cubemapShader.init(resourceDir + "/cubemap.vert", resourceDir + "/cubemap.frag");
 
 		// Initialize textures
@@ -236,12 +362,70 @@ public:
 		initGameObjects();
 	}
 
-	void initGameObjects()
+	bool isSoftwareRenderer()
+	{
+		std::string renderer = (const char*)glGetString(GL_RENDERER);
+		return renderer.find("llvmpipe") != std::string::npos ||
+			renderer.find("softpipe") != std::string::npos ||
+			renderer.find("SwiftShader") != std::string::npos;
+	}
+
+	// Sets up everything the simulation steps, without touching the GPU
+	void initSimulation()
 	{
 		// Initialize ocean
-		water = Water(1000, 100, WaveFunction::GERSTNER);
-		water.generateMesh();
-		water.generateWaves(2, 20.0f, 0.025f, 35.0f);
+		water = Water(1000, 100, (WaveFunction)settings.waveFunction);
+		water.generateWaves(settings.waveSeed, settings.medianWavelength,
+			settings.medianAmplitude, settings.spreadAngle, settings.waveCount);
+		water.generateSpectrum(settings.waveSeed, 256, 6.0f, glm::vec2(0.0f, -1.0f), SpectrumType::JONSWAP);
+
+		// Float each surfboard as a box half as dense as the water, so it
+		// rests half submerged
+		glm::vec3 boardSize(1.0f, 0.3f, 4.6f);
+		float boardMass = 0.5f * WATER_DENSITY * boardSize.x * boardSize.y * boardSize.z;
+		surfboardBodies[0] = buoyancy.addBody(glm::vec3(0.0f, 0.0f, 0.0f), boardSize, boardMass, 2, 4);
+		surfboardBodies[1] = buoyancy.addBody(glm::vec3(6.0f, 0.0f, 3.0f), boardSize, boardMass, 2, 4);
+		surfboardBodies[2] = buoyancy.addBody(glm::vec3(-6.0f, 0.0f, 3.0f), boardSize, boardMass, 2, 4);
+	}
+
+	void initGameObjects()
+	{
+		initSimulation();
+
+		// Send the ocean to the GPU
+		water.setupBuffers();
+		water.generateGrid();
+		water.generateProjectedGrid();
+		if (GLSL::supportsTessellation())
+		{
+			water.generatePatches();
+		}
+		water.generateClipmap();
+		water.generateQuadtree();
+
+		// Software renderers run the vertex shader on the CPU anyway, so
+		// displace the plane across all threads instead
+		if (isSoftwareRenderer())
+		{
+			std::cout << "Software renderer, displacing the water on the CPU\n";
+			water.generateMesh();
+			meshGenerated = true;
+			meshGeometry = WaterGeometry::CPU_MESH;
+		}
+
+		// Start on the quadtree patches, or the CPU displaced mesh
+		water.setGeometry(isSoftwareRenderer() ? meshGeometry : WaterGeometry::QUADTREE);
+
+		// Cover the water plane with texel centers on both edges
+		float planeLen = (float)water.getPlaneLength();
+		waveMap.init(resourceDir + "/wave_map.vert", resourceDir + "/wave_map.frag",
+			WAVE_MAP_RES, glm::vec2(-0.5f * planeLen), 
+			planeLen * WAVE_MAP_RES / (WAVE_MAP_RES - 1));
+
+		// Sample the heights under every hull point on the GPU when asked
+		// The bodies were added by initSimulation, so the probe count is final
+		gpuHeightsReady = heightSampler.init(resourceDir + "/height_sampler.vert", resourceDir + "/height_sampler.frag",
+			(int)buoyancy.getProbes().size());
 
 		// Load the cube mesh
 		loadObj(cube, resourceDir + "/cube.obj");
@@ -263,13 +447,13 @@ public:
 		surfboardMaterial = Material(&textureShader, glm::vec3(0.1f, 0.1f, 0.15f),
 			&surfboardDifTexture, &surfboardSpecTexture, 32.0f);
 
-		surfboard1 = GameObject(Transform(glm::vec3(0.0f, 1.0f, 0.0f), 
+		surfboard1 = GameObject(Transform(glm::vec3(0.0f), 
 			glm::vec3(0.0f, 90.0f, 0.0f), glm::vec3(1.0f)), &surfboard, &surfboardMaterial);
 
-		surfboard2 = GameObject(Transform(glm::vec3(6.0f, 1.0f, 3.0f),
+		surfboard2 = GameObject(Transform(glm::vec3(0.0f),
 			glm::vec3(0.0f, 90.0f, 0.0f), glm::vec3(1.0f)), &surfboard, &surfboardMaterial);
 
-		surfboard3 = GameObject(Transform(glm::vec3(-6.0f, 1.0f, 3.0f),
+		surfboard3 = GameObject(Transform(glm::vec3(0.0f),
 			glm::vec3(0.0f, 90.0f, 0.0f), glm::vec3(1.0f)), &surfboard, &surfboardMaterial);
 
 		// Load the dummy meshes
@@ -404,15 +588,156 @@ public:
 		return textureID;
 	}
 
+	// Advances the simulation in fixed steps, floating the game objects on
+	// the water at each step
+	void simulate()
+	{
+		while (time->stepSimulation())
+		{
+			water.advanceWaves(SIMULATION_STEP);
+			buoyancy.step(water, (float)SIMULATION_STEP);
+		}
+	}
+
+	// Each weather is rougher than the last, until the sea calms down again
+	// every third change
+	void setWeather(int weather)
+	{
+		if (weather == this->weather)
+		{
+			return;
+		}
+		this->weather = weather;
+
+		float roughness = 1.0f + weather % 3;
+		water.transitionWaves(settings.waveSeed + weather, settings.medianWavelength * roughness,
+			settings.medianAmplitude * roughness, settings.spreadAngle, settings.waveCount);
+	}
+
+	// Takes the time and inputs of the next frame from the replay, returning
+	// false once it runs out
+	bool playFrame(bool moveCamera)
+	{
+		ReplayFrame frame;
+		if (!replay.readFrame(frame))
+		{
+			moveDirection = glm::vec3(0.0f);
+			return false;
+		}
+
+		time->updateTime(frame.deltaTime);
+		moveDirection = frame.moveDirection;
+		water.setWaveFunction((WaveFunction)frame.waveFunction);
+		setWeather(frame.weather);
+		if (moveCamera)
+		{
+			camera.updateRotation(frame.rotation.x, frame.rotation.y);
+		}
+		return true;
+	}
+
+	void recordFrame()
+	{
+		ReplayFrame frame;
+		frame.deltaTime = time->getDeltaTime();
+		frame.moveDirection = moveDirection;
+		frame.rotation = frameRotation;
+		frame.waveFunction = water.getWaveFunction();
+		frame.weather = weather;
+		replay.recordFrame(frame);
+		frameRotation = glm::vec2(0.0f);
+	}
+
+	// Plays the replay back without a window as fast as possible, then
+	// prints the final state of the floating bodies
+	void replayHeadless()
+	{
+		initSimulation();
+
+		int frames = 0;
+		auto start = std::chrono::steady_clock::now();
+		while (playFrame(false))
+		{
+			simulate();
+			frames++;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::cout << "Replayed " << frames << " frames, " << time->getSimulationTime() <<
+			" s of simulation in " << elapsed.count() << " s\n";
+		std::cout << std::setprecision(9);
+		for (size_t i = 0; i < buoyancy.getBodyCount(); i++)
+		{
+			glm::vec3 position = buoyancy.getBody(i).position;
+			std::cout << "Body " << i << ": " << position.x << " " << position.y << " " << position.z << "\n";
+		}
+		std::cout << "State hash: " << std::hex << buoyancy.getStateHash() << std::dec << std::endl;
+	}
+
+	// Draws frames into an offscreen target as fast as possible, writing each
+	// one out as a PNG when given a directory, then prints the frame cost
+	bool renderOffscreen(int frames, const std::string& frameDir)
+	{
+		OffscreenTarget target;
+		if (!target.init(screenWidth, screenHeight))
+		{
+			return false;
+		}
+
+		// Writing the frames is left out of the frame cost
+		std::chrono::duration<double> renderTime(0.0);
+		for (int frame = 0; frame < frames; frame++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			target.bind();
+			run();
+			glFinish();
+			renderTime += std::chrono::steady_clock::now() - start;
+
+			if (!frameDir.empty())
+			{
+				std::ostringstream file;
+				file << frameDir << "/frame_" << std::setw(5) << std::setfill('0') << frame << ".png";
+				if (!target.save(file.str()))
+				{
+					return false;
+				}
+			}
+		}
+
+		double seconds = renderTime.count();
+		std::cout << "Rendered " << frames << " frames at " << screenWidth << "x" << screenHeight <<
+			" in " << seconds << " s, " << seconds * 1000.0 / frames << " ms per frame, " <<
+			frames / seconds << " frames per second\n";
+		return true;
+	}
+
 	void run()
 	{
-		// Update time
-		time->updateTime();
-		accumulatedTime += time->getDeltaTime();
-		accumulatedTime = fmod(accumulatedTime, 1000.0f);
+		// Update time, taking it from the replay while one is playing
+		// Offscreen frames run uncapped, so each one advances the clock by one
+		// simulation step instead of the time it took to draw
+		if (!replay.isPlaying() || !playFrame(true))
+		{
+			if (windowManager->isOffscreen())
+			{
+				time->updateTime(SIMULATION_STEP);
+			}
+			else
+			{
+				time->updateTime();
+			}
+		}
+		if (replay.isRecording())
+		{
+			recordFrame();
+		}
 
-		// Get current frame buffer size
-		glfwGetFramebufferSize(windowManager->getHandle(), &screenWidth, &screenHeight);
+		// Get current frame buffer size, which stays fixed offscreen
+		if (!windowManager->isOffscreen())
+		{
+			glfwGetFramebufferSize(windowManager->getHandle(), &screenWidth, &screenHeight);
+		}
 		glViewport(0, 0, screenWidth, screenHeight);
 
 		// Clear framebuffer
@@ -421,52 +746,103 @@ public:
 		// Update camera position and view matrix
 		camera.updatePosition(moveDirection, time->getDeltaTime());
 
-		// Update game objects
-		glm::vec3 displacement = water.getDisplacement(
-			surfboard1.transform.translation, accumulatedTime);
-		surfboard1.transform.translation = displacement;
-		dummyRoot.gameObject->transform.translation.y = displacement.y;
-
-		displacement = water.getDisplacement(
-			surfboard2.transform.translation, accumulatedTime);
-		surfboard2.transform.translation = displacement;
-
-		displacement = water.getDisplacement(
-			surfboard3.transform.translation, accumulatedTime);
-		surfboard3.transform.translation = displacement;
-
-		// Draw game objects
-		surfboard1.draw(lightDir, camera.getPosition());
-		surfboard2.draw(lightDir, camera.getPosition());
-		surfboard3.draw(lightDir, camera.getPosition());
-		dummyRoot.drawHierarchyFromRoot(lightDir, camera.getPosition());
+		// Catch the simulation up with the frame, taking in any heights the
+		// GPU has finished sampling first
+		if (useGpuHeights)
+		{
+			heightSampler.collect();
+		}
+		simulate();
+
+		// Draw everything between the last two steps, folding the waves for
+		// this frame and sending them to the GPU
+		float interpolation = time->getInterpolation();
+		double frameOffset = (interpolation - 1.0) * SIMULATION_STEP;
+		water.updateWaveFrame(frameOffset);
+		water.updateSurface();
+
+		// Sample the waves just sent under the hull points, to be read back
+		// in a later frame
+		if (useGpuHeights)
+		{
+			const SurfaceProbes& probes = buoyancy.getProbes();
+			heightSampler.request(water, probes.xs.data(), probes.zs.data(), probes.size(),
+				water.getWaveTime() + frameOffset);
+		}
+
+		glm::mat4 board1 = buoyancy.getBody(surfboardBodies[0]).getModelMatrix(interpolation);
+		glm::mat4 board2 = buoyancy.getBody(surfboardBodies[1]).getModelMatrix(interpolation);
+		glm::mat4 board3 = buoyancy.getBody(surfboardBodies[2]).getModelMatrix(interpolation);
+		glm::mat4 board1Model = board1 * surfboard1.transform.getCompositeTransform();
+		glm::mat4 board2Model = board2 * surfboard2.transform.getCompositeTransform();
+		glm::mat4 board3Model = board3 * surfboard3.transform.getCompositeTransform();
+
+		// Draw game objects, with the dummy riding the first surfboard
+		surfboard1.draw(lightDir, camera.getPosition(), &board1Model);
+		surfboard2.draw(lightDir, camera.getPosition(), &board2Model);
+		surfboard3.draw(lightDir, camera.getPosition(), &board3Model);
+		dummyRoot.drawHierarchyFromRoot(board1, lightDir, camera.getPosition());
 		//for (GameObject& dummy : dummyObjects)
 		//{
 		//	dummy.draw(lightDir, camera.getPosition());
 		//}
 
+		// Sum the waves into the wave map once per texel
+		// The spectral ocean already provides its own maps, and the wave map
+		// only covers the plane
+		bool samplePlane = water.getGeometry() == WaterGeometry::MESH ||
+			water.getGeometry() == WaterGeometry::GRID ||
+			water.getGeometry() == WaterGeometry::TESSELLATED;
+		bool sampleWaveMap = useWaveMap && samplePlane &&
+			water.getWaveFunction() != WaveFunction::SPECTRAL;
+		if (sampleWaveMap)
+		{
+			waveMap.render(water, camera.getPosition());
+			waveMap.bindTextures(DISPLACEMENT_MAP_UNIT, NORMAL_MAP_UNIT);
+		}
+
 		// Configure water shader and draw the water
 		glm::mat4 model(1.0f);
 		model = glm::mat4(1.0f);
 
-		waterShader.bind();
-		waterShader.setMat4("model", model);
-		waterShader.setFloat("time", accumulatedTime);
-		waterShader.setInt("waveFunction", water.getWaveFunction());
+		// The CPU displaced mesh only needs to be lit, and the tessellated
+		// patches are displaced in their own stages
+		Shader& shader = water.getGeometry() == WaterGeometry::CPU_MESH ? waterSurfaceShader :
+			water.getGeometry() == WaterGeometry::TESSELLATED ? waterTessShader : waterShader;
+
+		shader.bind();
+		shader.setMat4("model", model);
+		shader.setInt("waveFunction", water.getWaveFunction());
+		water.setWaveUniforms(shader);
+		shader.setVec3("lodOrigin", camera.getPosition());
+		shader.setFloat("lodScale", water.getLodScale());
+		shader.setInt("displacementMap", DISPLACEMENT_MAP_UNIT);
+		shader.setInt("normalMap", NORMAL_MAP_UNIT);
+		shader.setBool("useWaveMap", sampleWaveMap);
+		if (sampleWaveMap)
+		{
+			shader.setVec2("mapOrigin", waveMap.getOrigin());
+			shader.setFloat("mapLength", waveMap.getLength());
+		}
+		else
+		{
+			shader.setVec2("mapOrigin", glm::vec2(0.0f));
+			shader.setFloat("mapLength", water.getSpectrum().getLength());
+		}
 
 		// Bind the cubemap for skybox reflections
 		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 
-		waterShader.setVec3("lightDir", lightDir);
-		waterShader.setVec3("cameraPos", camera.getPosition());
-		waterShader.setVec3("matAmb", glm::vec3(0.1f, 0.1f, 0.2f));
-		waterShader.setVec3("matDif", glm::vec3(0.17f, 0.45f, 0.79f));
-		waterShader.setVec3("matSpec", glm::vec3(0.7f, 0.8f, 0.9f));
-		waterShader.setFloat("matShine", 100.0f);
-		waterShader.setBool("debugNormals", debugNormals);
+		shader.setVec3("lightDir", lightDir);
+		shader.setVec3("cameraPos", camera.getPosition());
+		shader.setVec3("matAmb", glm::vec3(0.1f, 0.1f, 0.2f));
+		shader.setVec3("matDif", glm::vec3(0.17f, 0.45f, 0.79f));
+		shader.setVec3("matSpec", glm::vec3(0.7f, 0.8f, 0.9f));
+		shader.setFloat("matShine", 100.0f);
+		shader.setBool("debugNormals", debugNormals);
 		
-		water.draw();
-		waterShader.unbind();
+		water.draw(shader, camera);
+		shader.unbind();
 
 		// Configure cubemap shader
 		model = glm::mat4(1.0f);
@@ -492,9 +868,64 @@ int main(int argc, char *argv[])
 	// Where the resources are loaded from
 	application.resourceDir = "../../../resources";
 
-	if (argc >= 2)
+	// Optional arguments after the resource directory
+	//   --record <file>	records the inputs of the run
+	//   --replay <file>	plays a recorded run back
+	//   --headless			plays the replay back without a window
+	//   --offscreen <n>	renders n frames without a display and times them
+	//   --frames <dir>		writes the offscreen frames to the directory
+	std::string recordPath, replayPath, frameDir;
+	bool headless = false;
+	int offscreenFrames = 0;
+	for (int i = 1; i < argc; i++)
 	{
-		application.resourceDir = argv[1];
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc)
+		{
+			recordPath = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			replayPath = argv[++i];
+		}
+		else if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--offscreen" && i + 1 < argc)
+		{
+			offscreenFrames = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			frameDir = argv[++i];
+		}
+		else
+		{
+			application.resourceDir = arg;
+		}
+	}
+
+	// A replay brings the settings it was recorded with
+	if (!replayPath.empty())
+	{
+		if (!application.replay.startPlayback(replayPath))
+		{
+			return 1;
+		}
+		application.settings = application.replay.getSettings();
+	}
+
+	if (headless)
+	{
+		if (replayPath.empty())
+		{
+			std::cerr << "--headless needs a replay to play" << std::endl;
+			return 1;
+		}
+		application.time = Time::getInstance();
+		application.replayHeadless();
+		return 0;
 	}
 
 	// Your main will always include a similar set up to establish your window
@@ -503,8 +934,18 @@ int main(int argc, char *argv[])
 	application.screenHeight = 480;
 
 	WindowManager* windowManager = WindowManager::getInstance();
-	windowManager->init(application.screenWidth, application.screenHeight);
-	windowManager->setEventCallbacks(&application);
+	if (offscreenFrames > 0)
+	{
+		if (!windowManager->initOffscreen(application.screenWidth, application.screenHeight))
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		windowManager->init(application.screenWidth, application.screenHeight);
+		windowManager->setEventCallbacks(&application);
+	}
 	application.windowManager = windowManager;
 
 	// This is the code that will likely change program to program as you
@@ -514,6 +955,19 @@ int main(int argc, char *argv[])
 	// Set up time
 	application.time = Time::getInstance();
 
+	if (!recordPath.empty() && !application.replay.startRecording(recordPath, application.settings))
+	{
+		return 1;
+	}
+
+	if (offscreenFrames > 0)
+	{
+		bool rendered = application.renderOffscreen(offscreenFrames, frameDir);
+		application.dummyRoot.clearHierarchy();
+		windowManager->shutdown();
+		return rendered ? 0 : 1;
+	}
+
 	// Loop until the user closes the window
 	while (!glfwWindowShouldClose(windowManager->getHandle()))
 	{